@@ -69,6 +69,13 @@ run-rom: $(PROGRAM).rom $(PROGRAM).elf $(PROGRAM).adf
 	$(LAUNCH) $(LAUNCHOPTS) \
 	  -r $(PROGRAM).rom -e $(PROGRAM).elf -f $(PROGRAM).adf
 
+# Serial port is connected to remote file server instead of a terminal.
+REMOTEDIR ?= .
+
+run-serial: $(PROGRAM).elf $(PROGRAM).adf
+	$(LAUNCH) $(LAUNCHOPTS) \
+	  -s $(REMOTEDIR) -f $(PROGRAM).adf -e $(PROGRAM).elf
+
 debug-floppy: $(PROGRAM).elf $(PROGRAM).adf
 	$(LAUNCH) $(LAUNCHOPTS) \
 	  -d -f $(PROGRAM).adf -e $(PROGRAM).elf
@@ -77,4 +84,4 @@ debug-rom: $(PROGRAM).rom $(PROGRAM).elf $(PROGRAM).adf
 	$(LAUNCH) $(LAUNCHOPTS) \
 	  -d -r $(PROGRAM).rom -e $(PROGRAM).elf -f $(PROGRAM).adf
 
-.PHONY: debug-floppy debug-rom run-floppy run-rom
+.PHONY: debug-floppy debug-rom run-floppy run-rom run-serial
@@ -0,0 +1,101 @@
+#include <blitter.h>
+#include <string.h>
+#include <strings.h>
+
+/* There's no real Amiga that has more than 2MiB of chip memory. */
+#define CHIPMEM_END (1U << 21)
+
+/* Maximum blit size is 64 words wide and 1024 lines high. */
+#define MAXWIDTH 64
+#define MAXHEIGHT 1024
+
+size_t BltMemThreshold = 256;
+
+static bool BltMemSuitable(void *dst, const void *src, size_t size) {
+  if (size < BltMemThreshold)
+    return false;
+  if (((uintptr_t)dst | (uintptr_t)src) & 1)
+    return false;
+  if ((uintptr_t)dst + size > CHIPMEM_END)
+    return false;
+  if (src && (uintptr_t)src + size > CHIPMEM_END)
+    return false;
+  return true;
+}
+
+/* Start a blit that copies (or clears if `src` is NULL) the buffer treated as
+ * a bitmap with rows of 128 bytes. Returns number of bytes to be processed. */
+static size_t BltMemStart(void *dst, const void *src, size_t size) {
+  size_t words = size >> 1;
+  uint16_t width, height;
+
+  if (words >= MAXWIDTH) {
+    width = MAXWIDTH;
+    height = min(words / MAXWIDTH, (size_t)MAXHEIGHT);
+  } else {
+    width = words;
+    height = 1;
+  }
+
+  WaitBlitter();
+
+  if (src) {
+    custom.bltcon0 = (SRCA | DEST) | A_TO_D;
+    custom.bltapt = (void *)src;
+  } else {
+    custom.bltcon0 = DEST;
+  }
+  custom.bltcon1 = 0;
+  custom.bltafwm = -1;
+  custom.bltalwm = -1;
+  custom.bltamod = 0;
+  custom.bltdmod = 0;
+  custom.bltdpt = dst;
+  custom.bltsize = ((height & (MAXHEIGHT - 1)) << 6) | (width & (MAXWIDTH - 1));
+
+  return (size_t)width * height * sizeof(uint16_t);
+}
+
+static void CpuMem(void *dst, const void *src, size_t size) {
+  if (src)
+    memcpy(dst, src, size);
+  else
+    bzero(dst, size);
+}
+
+static void BltMemGeneric(void *dst, const void *src, size_t size,
+                          const BltMemJob_t *cpu) {
+  if (!BltMemSuitable(dst, src, size)) {
+    CpuMem(dst, src, size);
+    if (cpu)
+      CpuMem(cpu->dst, cpu->src, cpu->size);
+    return;
+  }
+
+  /* The blitter handles words only, the CPU takes odd trailing byte. */
+  size_t blt = size & ~1;
+  size_t done = BltMemStart(dst, src, blt);
+
+  /* Let the CPU do its job while the blitter is busy. */
+  if (cpu)
+    CpuMem(cpu->dst, cpu->src, cpu->size);
+  if (blt < size)
+    CpuMem(dst + blt, src ? src + blt : NULL, size - blt);
+
+  while (done < blt)
+    done += BltMemStart(dst + done, src ? src + done : NULL, blt - done);
+
+  WaitBlitter();
+}
+
+void BltMemCopy(void *dst, const void *src, size_t size) {
+  BltMemGeneric(dst, src, size, NULL);
+}
+
+void BltMemClear(void *dst, size_t size) {
+  BltMemGeneric(dst, NULL, size, NULL);
+}
+
+void BltMemHybrid(const BltMemJob_t *blt, const BltMemJob_t *cpu) {
+  BltMemGeneric(blt->dst, blt->src, blt->size, cpu);
+}
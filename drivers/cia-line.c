@@ -6,6 +6,7 @@
 #include <interrupt.h>
 
 static List_t WaitingTasks;
+static uint32_t Base; /* lines counted before the last rebase */
 
 /* All TOD registers latch on a read of MSB event and remain latched
  * until after a read of LSB event. */
@@ -34,6 +35,24 @@ static void SetAlarm(uint32_t line) {
   BCLR(*ciacrb, CIACRAB_TODIN);
 }
 
+/* The counter is 24 bits wide, so it wraps around after about 18 minutes.
+ * Before an alarm would fall past that point, restart the counter from zero
+ * and shift the pending alarms accordingly. */
+#define COUNTER_MAX 0xffffff
+
+static void Rebase(uint32_t curr) {
+  const ListItem_t *end = listGET_END_MARKER(&WaitingTasks);
+  ListItem_t *item = listGET_HEAD_ENTRY(&WaitingTasks);
+
+  for (; item != end; item = listGET_NEXT(item)) {
+    uint32_t alarm = listGET_LIST_ITEM_VALUE(item);
+    listSET_LIST_ITEM_VALUE(item, alarm > curr ? alarm - curr : 1);
+  }
+
+  Base += curr;
+  SetCounter(0);
+}
+
 static void LineCounterHandler(List_t *tasks) {
   /* CIA requires the interrupt to be acknowledged by the handler.
    * This is done by reading the value in Interrupt Control Register */
@@ -62,6 +81,7 @@ static void LineCounterHandler(List_t *tasks) {
 INTSERVER_DEFINE(LineCounter, 0, (ISR_t)LineCounterHandler, &WaitingTasks);
 
 void LineCounterInit(void) {
+  Base = 0;
   SetCounter(0);
   vListInitialise(&WaitingTasks);
   AddIntServer(ExterChain, LineCounter);
@@ -80,16 +100,31 @@ void LineCounterWait(uint32_t lines) {
     if (WaitingTasks.uxNumberOfItems == 0)
       WriteICR(CIAB, CIAICRF_SETCLR | CIAICRF_ALRM);
     /* Calculate wakeup time. */
-    uint32_t alarm = GetCounter() + lines;
+    uint32_t curr = GetCounter();
+    bool rebase = curr + lines > COUNTER_MAX;
+    if (rebase) {
+      Rebase(curr);
+      curr = 0;
+    }
+    uint32_t alarm = curr + lines;
     /* Insert currently running task onto waiting tasks list. */
     xTaskHandle owner = xTaskGetCurrentTaskHandle();
     ListItem_t item = {.xItemValue = alarm, .pvOwner = owner};
     vListInitialiseItem(&item);
     vListInsert(&WaitingTasks, &item);
     /* Reprogram TOD alarm if inserted task should be woken up as first. */
-    if (listGET_HEAD_ENTRY(&WaitingTasks) == &item)
-      SetAlarm(alarm);
+    if (rebase || listGET_HEAD_ENTRY(&WaitingTasks) == &item)
+      SetAlarm(listGET_ITEM_VALUE_OF_HEAD_ENTRY(&WaitingTasks));
     (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
   }
   taskEXIT_CRITICAL();
 }
+
+/* Reading from an interrupt handler must not break the latch of a task
+ * reading the counter, so interrupts are masked in either case. */
+uint32_t LineCounterRead(void) {
+  uint32_t ipl = portSET_INTERRUPT_MASK_FROM_ISR();
+  uint32_t line = Base + GetCounter();
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(ipl);
+  return line;
+}
@@ -112,3 +112,46 @@ void WaitTimerGeneric(CIATimer_t *timer, uint16_t delay, bool spin) {
     (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
   }
 }
+
+void StartTimer(CIATimer_t *timer) {
+  CIA_t cia = timer->cia;
+  uint8_t icr = timer->icr;
+
+  /* Measurement does not need the interrupt. */
+  WriteICR(cia, icr);
+
+  /* Load counter with maximum value and start timer in continuous mode. */
+  if (icr == CIAICRF_TB) {
+    cia->ciacrb &= ~CIACRBF_START;
+    cia->ciacrb |= CIACRBF_LOAD;
+    cia->ciatblo = 0xff;
+    cia->ciatbhi = 0xff;
+    cia->ciacrb = (cia->ciacrb & ~CIACRBF_RUNMODE) | CIACRBF_START;
+  } else {
+    cia->ciacra &= ~CIACRAF_START;
+    cia->ciacra |= CIACRAF_LOAD;
+    cia->ciatalo = 0xff;
+    cia->ciatahi = 0xff;
+    cia->ciacra = (cia->ciacra & ~CIACRAF_RUNMODE) | CIACRAF_START;
+  }
+}
+
+uint16_t ReadTimer(CIATimer_t *timer) {
+  CIA_t cia = timer->cia;
+  uint8_t hi, lo;
+
+  /* Low byte may underflow between reads, so make sure high byte is stable. */
+  if (timer->icr == CIAICRF_TB) {
+    do {
+      hi = cia->ciatbhi;
+      lo = cia->ciatblo;
+    } while (hi != cia->ciatbhi);
+  } else {
+    do {
+      hi = cia->ciatahi;
+      lo = cia->ciatalo;
+    } while (hi != cia->ciatahi);
+  }
+
+  return 0xffff - ((hi << 8) | lo);
+}
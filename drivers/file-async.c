@@ -0,0 +1,62 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+#include <FreeRTOS/queue.h>
+
+#include <file.h>
+
+/* Maximum number of requests waiting for the worker task. */
+#define FILEREQ_MAXNUM 8
+
+static xTaskHandle FileWorkerTask;
+static QueueHandle_t FileWorkerQueue;
+
+/* Emulate asynchronous reads for drivers that can only do synchronous ones. */
+static void FileWorker(__unused void *ptr) {
+  for (;;) {
+    FileReq_t *req;
+
+    (void)xQueueReceive(FileWorkerQueue, &req, portMAX_DELAY);
+
+    req->result = FileRead(req->file, req->buf, req->nbyte);
+    (void)xQueueSend(req->replyQueue, &req, portMAX_DELAY);
+  }
+}
+
+void FileAsyncInit(unsigned aWorkerTaskPrio) {
+  FileWorkerQueue = xQueueCreate(FILEREQ_MAXNUM, sizeof(FileReq_t *));
+  configASSERT(FileWorkerQueue != NULL);
+
+  xTaskCreate(FileWorker, "FileWorker", configMINIMAL_STACK_SIZE, NULL,
+              aWorkerTaskPrio, &FileWorkerTask);
+  configASSERT(FileWorkerTask != NULL);
+}
+
+void FileAsyncKill(void) {
+  vTaskDelete(FileWorkerTask);
+  vQueueDelete(FileWorkerQueue);
+  FileWorkerTask = NULL;
+}
+
+bool FileReadAsync(File_t *f, FileReq_t *req) {
+  if (f->wbuflen)
+    FileFlush(f);
+
+  req->file = f;
+
+  if (f->ops->readasync)
+    return f->ops->readasync(f, req);
+
+  if (!f->ops->read) {
+    req->result = -1;
+    return xQueueSend(req->replyQueue, &req, portMAX_DELAY);
+  }
+
+  configASSERT(FileWorkerTask != NULL);
+  return xQueueSend(FileWorkerQueue, &req, portMAX_DELAY);
+}
+
+FileReq_t *FileWaitAsync(QueueHandle_t replyQueue) {
+  FileReq_t *req = NULL;
+  (void)xQueueReceive(replyQueue, &req, portMAX_DELAY);
+  return req;
+}
@@ -1,36 +1,184 @@
+#include <FreeRTOS/FreeRTOS.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <file.h>
 
 long FileRead(File_t *f, void *buf, size_t nbyte) {
+  if (f->wbuflen)
+    FileFlush(f);
   return f->ops->read ? f->ops->read(f, buf, nbyte) : -1;
 }
 
+static bool HasNewline(const char *buf, size_t nbyte) {
+  while (nbyte--)
+    if (*buf++ == '\n')
+      return true;
+  return false;
+}
+
 long FileWrite(File_t *f, const void *buf, size_t nbyte) {
-  return f->ops->write ? f->ops->write(f, buf, nbyte) : -1;
+  if (!f->ops->write)
+    return -1;
+
+  if (f->wbufmode == FBUF_NONE)
+    return f->ops->write(f, buf, nbyte);
+
+  /* Make room for new data. If it won't fit anyway then bypass the buffer. */
+  if (f->wbuflen + nbyte > f->wbufsize) {
+    if (FileFlush(f) < 0)
+      return -1;
+    if (nbyte >= f->wbufsize)
+      return f->ops->write(f, buf, nbyte);
+  }
+
+  memcpy(f->wbuf + f->wbuflen, buf, nbyte);
+  f->wbuflen += nbyte;
+
+  if (f->wbuflen == f->wbufsize ||
+      (f->wbufmode == FBUF_LINE && HasNewline(buf, nbyte))) {
+    if (FileFlush(f) < 0) {
+      /* New data that did not reach the driver is reported as not written,
+       * so the caller may retry it. Older data stays buffered. */
+      size_t left = min(f->wbuflen, nbyte);
+      f->wbuflen -= left;
+      return left < nbyte ? (long)(nbyte - left) : -1;
+    }
+  }
+
+  return nbyte;
 }
 
 long FileSeek(File_t *f, long offset, int whence) {
+  if (f->wbuflen && FileFlush(f) < 0)
+    return -1;
   return f->ops->seek ? f->ops->seek(f, offset, whence) : -1;
 }
 
 void FileClose(File_t *f) {
+  if (f->wbuflen)
+    FileFlush(f);
   if (f->ops->close)
     f->ops->close(f);
 }
 
+long FileReadV(File_t *f, const IoVec_t *iov, int iovcnt) {
+  long done = 0;
+
+  if (f->wbuflen)
+    FileFlush(f);
+
+  if (f->ops->readv)
+    return f->ops->readv(f, iov, iovcnt);
+
+  if (!f->ops->read)
+    return -1;
+
+  for (int i = 0; i < iovcnt; i++) {
+    long n = f->ops->read(f, iov[i].base, iov[i].len);
+    if (n < 0)
+      return done ? done : n;
+    done += n;
+    if ((size_t)n < iov[i].len)
+      break;
+  }
+
+  return done;
+}
+
+long FileWriteV(File_t *f, const IoVec_t *iov, int iovcnt) {
+  long done = 0;
+
+  /* Buffered writes are handled by FileWrite. */
+  if (f->ops->writev && f->wbufmode == FBUF_NONE)
+    return f->ops->writev(f, iov, iovcnt);
+
+  for (int i = 0; i < iovcnt; i++) {
+    long n = FileWrite(f, iov[i].base, iov[i].len);
+    if (n < 0)
+      return done ? done : n;
+    done += n;
+    if ((size_t)n < iov[i].len)
+      break;
+  }
+
+  return done;
+}
+
+long FileMap(File_t *f, const void **bufp, size_t nbyte) {
+  void *buf;
+  long n;
+
+  if (f->wbuflen)
+    FileFlush(f);
+
+  if (f->ops->map)
+    return f->ops->map(f, bufp, nbyte);
+
+  /* Fallback: lend a temporary buffer filled by regular read. */
+  if (!f->ops->read || !(buf = pvPortMalloc(nbyte)))
+    return -1;
+
+  if ((n = f->ops->read(f, buf, nbyte)) <= 0) {
+    vPortFree(buf);
+    return n;
+  }
+
+  *bufp = buf;
+  return n;
+}
+
+void FileUnmap(File_t *f, const void *buf, size_t nbyte) {
+  if (f->ops->map) {
+    if (f->ops->unmap)
+      f->ops->unmap(f, buf, nbyte);
+  } else {
+    vPortFree((void *)buf);
+  }
+}
+
+void FileSetBuf(File_t *f, short mode, void *buf, size_t size) {
+  if (f->wbuflen)
+    FileFlush(f);
+  if (buf == NULL || size == 0)
+    mode = FBUF_NONE;
+  f->wbufmode = mode;
+  f->wbuf = (mode == FBUF_NONE) ? NULL : buf;
+  f->wbufsize = (mode == FBUF_NONE) ? 0 : size;
+}
+
+long FileFlush(File_t *f) {
+  size_t nbyte = f->wbuflen;
+  long n;
+
+  if (nbyte == 0)
+    return 0;
+
+  if (!f->ops->write || (n = f->ops->write(f, f->wbuf, nbyte)) < 0)
+    return -1;
+
+  /* Keep the tail that the driver did not take. */
+  f->wbuflen = nbyte - n;
+  if (f->wbuflen) {
+    memmove(f->wbuf, f->wbuf + n, f->wbuflen);
+    return -1;
+  }
+
+  return 0;
+}
+
 void FilePutChar(File_t *f, char c) {
   FileWrite(f, &c, 1);
 }
 
 void FilePrintf(File_t *f, const char *fmt, ...) {
-  void PutChar(char c) {
-    FileWrite(f, &c, 1);
+  void PutStr(const char *s, size_t n) {
+    FileWrite(f, s, n);
   }
 
   va_list ap;
 
   va_start(ap, fmt);
-  kvprintf(PutChar, fmt, ap);
+  kvprintf_bulk(PutStr, fmt, ap);
   va_end(ap);
 }
@@ -0,0 +1,214 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/semphr.h>
+
+#include <blitter.h>
+#include <custom.h>
+#include <interrupt.h>
+#include <floppy.h>
+
+#include "floppy-mfm.h"
+
+/*
+ * Blitter decoder. Descending mode makes A shift left, so odd bits land in
+ * their place, while constant C selects bits from A or even bits from B:
+ * D = (A << 1) & ~0x5555 | B & 0x5555. Each sector takes one blit of
+ * 256 words. Blitter interrupt starts the next one.
+ */
+
+#define BLTDECODE (ASHIFT(1) | (SRCA | SRCB | DEST) | (ABC | ABNC | ANBNC | NABC))
+#define BLTWIDTH 64
+#define BLTSIZE(words) ((((words) / BLTWIDTH) << 6) | (BLTWIDTH & 63))
+
+/* State of the chain, which belongs to the holder of BltLock. It's taken by
+ * BltDecodeTrack or BltEncodeTrack and given back once the chain is done. */
+static SemaphoreHandle_t BltLock;
+static SemaphoreHandle_t BltDone;
+static DiskSector_t *BltSectors[SECTOR_COUNT_MAX];
+static uint32_t *BltBuf;
+static short BltNext;
+static short BltCount;
+static void (*BltStart)(short i);
+
+/* Clock bits computed by the encoder. */
+static uint16_t *BltScratch;
+
+void FloppyBltInit(void) {
+  BltLock = xSemaphoreCreateBinary();
+  BltDone = xSemaphoreCreateBinary();
+  BltScratch = pvPortMallocChip(SECTOR_PAYLOAD * 2 + sizeof(uint16_t));
+  configASSERT(BltLock != NULL && BltDone != NULL && BltScratch != NULL);
+  xSemaphoreGive(BltLock);
+}
+
+void FloppyBltKill(void) {
+  vPortFree(BltScratch);
+  vSemaphoreDelete(BltDone);
+  vSemaphoreDelete(BltLock);
+}
+
+static void BltDecodeStart(short i) {
+  DiskSector_t *sector = BltSectors[i];
+  void *dst = BltBuf + i * SECTOR_SIZE / sizeof(uint32_t);
+
+  /* Pointers to the last word of each buffer, as blitter goes backwards. */
+  custom.bltapt = (void *)sector->data[0] + SECTOR_PAYLOAD - 2;
+  custom.bltbpt = (void *)sector->data[1] + SECTOR_PAYLOAD - 2;
+  custom.bltdpt = dst + SECTOR_PAYLOAD - 2;
+  custom.bltsize = BLTSIZE(SECTOR_PAYLOAD / 2);
+}
+
+static void BltChainDone(__unused void *ptr) {
+  if (++BltNext < BltCount) {
+    BltStart(BltNext);
+  } else {
+    DisableINT(INTF_BLIT);
+    xSemaphoreGiveFromISR(BltDone, &xNeedRescheduleTask);
+  }
+}
+
+/* Run `n` blits one after another, `start` sets up registers for each. */
+static void BltChainRun(void (*start)(short i), short n) {
+  BltStart = start;
+  BltNext = 0;
+  BltCount = n;
+
+  SetIntVec(BLIT, BltChainDone, NULL);
+  ClearIRQ(INTF_BLIT);
+  EnableINT(INTF_BLIT);
+
+  start(0);
+}
+
+void BltDecodeTrack(DiskSector_t *sectors[], short n, void *buf) {
+  configASSERT(n > 0 && n <= SECTOR_COUNT_MAX);
+
+  xSemaphoreTake(BltLock, portMAX_DELAY);
+
+  for (short i = 0; i < n; i++)
+    BltSectors[i] = sectors[i];
+  BltBuf = buf;
+
+  EnableDMA(DMAF_BLITTER);
+  WaitBlitter();
+
+  custom.bltcon0 = BLTDECODE;
+  custom.bltcon1 = BLITREVERSE;
+  custom.bltafwm = -1;
+  custom.bltalwm = -1;
+  custom.bltamod = 0;
+  custom.bltbmod = 0;
+  custom.bltdmod = 0;
+  custom.bltcdat = 0x5555;
+
+  BltChainRun(BltDecodeStart, n);
+}
+
+void BltDecodeWait(void) {
+  xSemaphoreTake(BltDone, portMAX_DELAY);
+  xSemaphoreGive(BltLock);
+}
+
+/*
+ * Blitter encoder. Sector headers are encoded by the CPU, and data of each
+ * sector takes four blits, with C being a constant mask:
+ *  1. odd bits: D = (A >> 1) & 0x5555
+ *  2. even bits: D = A & 0x5555
+ *  3. clock bits into scratch buffer: D = ~(A >> 1) & ~(B << 1) & 0xaaaa
+ *  4. merge: D = A | B
+ * Ascending blit shifts in bits of the previous word, so shifting B right by
+ * 15 gives B << 1 one word late. Hence the third blit starts one word early
+ * with A and covers one extra word, which ends up in front of scratch
+ * buffer. That way each clock bit is computed from its neighbours, including
+ * the last bit of data checksum. Only the first bit of the next sector has
+ * to be fixed by the CPU.
+ */
+
+#define BLTSPLIT (SRCA | DEST | (ABC | ANBC))
+#define BLTCLOCK (ASHIFT(1) | SRCA | SRCB | DEST | NANBC)
+#define BLTCLOCKSIZE ((19 << 6) | 27) /* 513 words */
+#define BLTMERGE (SRCA | SRCB | DEST | (ABC | ABNC | ANBC | ANBNC | NABC | NABNC))
+
+static const uint32_t *BltSrc;
+
+static void BltEncodeStart(short i) {
+  DiskSector_t *sector = BltSectors[i / 4];
+  const void *src = BltSrc + (i / 4) * SECTOR_SIZE / sizeof(uint32_t);
+  void *data = sector->data;
+
+  switch (i % 4) {
+    case 0:
+      custom.bltcon0 = ASHIFT(1) | BLTSPLIT;
+      custom.bltcon1 = 0;
+      custom.bltcdat = 0x5555;
+      custom.bltapt = (void *)src;
+      custom.bltdpt = sector->data[0];
+      custom.bltsize = BLTSIZE(SECTOR_PAYLOAD / 2);
+      break;
+    case 1:
+      custom.bltcon0 = BLTSPLIT;
+      custom.bltapt = (void *)src;
+      custom.bltdpt = sector->data[1];
+      custom.bltsize = BLTSIZE(SECTOR_PAYLOAD / 2);
+      break;
+    case 2:
+      /* B reads one word past the area, but it only affects a data bit. */
+      custom.bltcon0 = BLTCLOCK;
+      custom.bltcon1 = BSHIFT(15);
+      custom.bltcdat = 0xaaaa;
+      custom.bltapt = data - 2;
+      custom.bltbpt = data;
+      custom.bltdpt = BltScratch;
+      custom.bltsize = BLTCLOCKSIZE;
+      break;
+    case 3:
+      custom.bltcon0 = BLTMERGE;
+      custom.bltcon1 = 0;
+      custom.bltapt = data;
+      custom.bltbpt = BltScratch + 1;
+      custom.bltdpt = data;
+      custom.bltsize = BLTSIZE(SECTOR_PAYLOAD);
+      break;
+  }
+}
+
+void BltEncodeTrack(DiskTrack_t *track, const FloppyGeometry_t *geometry,
+                    uint16_t num, const void *buf) {
+  DiskSector_t *sec = EncodeGap(track, geometry);
+  const uint32_t *data = buf;
+  short n = geometry->sectors;
+
+  xSemaphoreTake(BltLock, portMAX_DELAY);
+
+  for (short i = 0; i < n; i++) {
+    EncodeHeader(&sec[i], num, i, n, data);
+    BltSectors[i] = &sec[i];
+    data += SECTOR_SIZE / sizeof(uint32_t);
+  }
+  BltSrc = buf;
+
+  EnableDMA(DMAF_BLITTER);
+  WaitBlitter();
+
+  custom.bltafwm = -1;
+  custom.bltalwm = -1;
+  custom.bltamod = 0;
+  custom.bltbmod = 0;
+  custom.bltdmod = 0;
+
+  BltChainRun(BltEncodeStart, n * 4);
+}
+
+void BltEncodeWait(void) {
+  short n = BltCount / 4;
+
+  xSemaphoreTake(BltDone, portMAX_DELAY);
+
+  /* First bit of the next sector depends on the last bit of this one. */
+  for (short i = 0; i + 1 < n; i++) {
+    uint32_t *data = (uint32_t *)BltSectors[i]->data;
+    uint32_t last = data[2 * SECTOR_PAYLOAD / sizeof(uint32_t) - 1];
+    BltSectors[i + 1]->magic = AddClock(last, 0);
+  }
+
+  xSemaphoreGive(BltLock);
+}
@@ -0,0 +1,432 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+#include <FreeRTOS/queue.h>
+#include <FreeRTOS/semphr.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <floppy.h>
+
+/* Number of tracks that can be read from the disk at the same time. Each one
+ * needs a raw track buffer in chip memory. */
+#define TRACKCACHE_NIO 2
+
+typedef struct TrackSlot {
+  short track;  /* -1 if contents are not valid */
+  short refcnt; /* number of users holding the data */
+  uint32_t lastUsed;
+  bool loading;
+  bool failed; /* the track could not be read */
+  bool dirty;  /* modified, but not written back yet */
+  /* Taken while the track is being read, so the others can wait for it. */
+  SemaphoreHandle_t ready;
+  uint32_t data[TRACK_DATA_SIZE_MAX / sizeof(uint32_t)];
+} TrackSlot_t;
+
+static SemaphoreHandle_t CacheLock;
+static TrackSlot_t *Slot[TRACK_COUNT];
+static short NSlots;
+static short MaxSlots;
+static uint32_t Clock;
+static uint32_t Changes;
+static TrackCacheStats_t Stats;
+
+/* Modified tracks are written back by the flusher task. Only one task at a
+ * time writes them, so TrackCacheSync waits for the one being written. */
+static xTaskHandle Flusher;
+static xTaskHandle Killer;
+static SemaphoreHandle_t FlushLock;
+static short NDirty;
+static volatile bool Pressure; /* cache grew beyond its size */
+static volatile bool Exiting;
+
+/* Idle requests with their own track buffers and reply queues. */
+static FloppyIO_t IO[TRACKCACHE_NIO];
+static QueueHandle_t IOPool;
+
+static void TrackCacheFlusher(void *);
+
+void TrackCacheInit(short ntracks, unsigned flushPrio) {
+  printf("[Init] Track cache!\n");
+
+  CacheLock = xSemaphoreCreateBinary();
+  configASSERT(CacheLock != NULL);
+  xSemaphoreGive(CacheLock);
+
+  FlushLock = xSemaphoreCreateBinary();
+  configASSERT(FlushLock != NULL);
+  xSemaphoreGive(FlushLock);
+
+  IOPool = xQueueCreate(TRACKCACHE_NIO, sizeof(FloppyIO_t *));
+  configASSERT(IOPool != NULL);
+
+  for (short i = 0; i < TRACKCACHE_NIO; i++) {
+    FloppyIO_t *io = &IO[i];
+    io->cmd = CMD_READ;
+    io->buffer = AllocTrack();
+    io->replyQueue = xQueueCreate(1, sizeof(FloppyIO_t *));
+    configASSERT(io->buffer != NULL && io->replyQueue != NULL);
+    (void)xQueueSend(IOPool, &io, 0);
+  }
+
+  NSlots = 0;
+  MaxSlots = ntracks;
+  NDirty = 0;
+  Pressure = false;
+  Exiting = false;
+  Changes = FloppyDiskChanges(0);
+
+  xTaskCreate(TrackCacheFlusher, "TrackCacheFlusher", configMINIMAL_STACK_SIZE,
+              NULL, flushPrio, &Flusher);
+}
+
+static void FreeSlot(short i) {
+  TrackSlot_t *ts = Slot[i];
+  vSemaphoreDelete(ts->ready);
+  vPortFree(ts);
+  Slot[i] = Slot[--NSlots];
+}
+
+/* Modified tracks are written back before the flusher exits. */
+void TrackCacheKill(void) {
+  Killer = xTaskGetCurrentTaskHandle();
+  Exiting = true;
+  xTaskNotifyGive(Flusher);
+  (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  while (NSlots > 0)
+    FreeSlot(0);
+
+  for (short i = 0; i < TRACKCACHE_NIO; i++) {
+    vPortFree(IO[i].buffer);
+    vQueueDelete(IO[i].replyQueue);
+  }
+
+  vQueueDelete(IOPool);
+  vSemaphoreDelete(FlushLock);
+  vSemaphoreDelete(CacheLock);
+}
+
+/* Free least recently used slots that are not in use until the cache fits
+ * within its size. Modified slots are freed after they're written back. */
+static void Shrink(void) {
+  while (NSlots > MaxSlots) {
+    short victim = -1;
+
+    for (short i = 0; i < NSlots; i++) {
+      TrackSlot_t *ts = Slot[i];
+      if (ts->refcnt == 0 && !ts->dirty &&
+          (victim < 0 || ts->lastUsed < Slot[victim]->lastUsed))
+        victim = i;
+    }
+
+    if (victim < 0)
+      break;
+
+    FreeSlot(victim);
+  }
+}
+
+void TrackCacheSetSize(short ntracks) {
+  xSemaphoreTake(CacheLock, portMAX_DELAY);
+  MaxSlots = max(ntracks, (short)0);
+  Shrink();
+  xSemaphoreGive(CacheLock);
+}
+
+static TrackSlot_t *Lookup(short track) {
+  for (short i = 0; i < NSlots; i++)
+    if (Slot[i]->track == track)
+      return Slot[i];
+  return NULL;
+}
+
+/* Find a slot for a new track: allocate one if there's room, otherwise reuse
+ * the least recently used one. Slots in use or modified are never reused, so
+ * the cache may temporarily grow beyond its size. In the latter case modified
+ * slots are written back right away. */
+static TrackSlot_t *Replace(void) {
+  TrackSlot_t *ts = NULL;
+
+  if (NSlots >= MaxSlots) {
+    for (short i = 0; i < NSlots; i++) {
+      TrackSlot_t *other = Slot[i];
+      if (other->refcnt == 0 && !other->dirty &&
+          (!ts || other->lastUsed < ts->lastUsed))
+        ts = other;
+    }
+    if (ts)
+      return ts;
+    if (NDirty > 0) {
+      Pressure = true;
+      xTaskNotifyGive(Flusher);
+    }
+  }
+
+  if (!(ts = pvPortMalloc(sizeof(TrackSlot_t))))
+    return NULL;
+
+  if (!(ts->ready = xSemaphoreCreateBinary())) {
+    vPortFree(ts);
+    return NULL;
+  }
+
+  Slot[NSlots++] = ts;
+  return ts;
+}
+
+/* Data read from the previous disk must not be returned. Tracks in use keep
+ * their data, but they won't be found anymore. Modifications that were not
+ * written back cannot be written to another disk, so they're lost. */
+static void CheckDiskChange(void) {
+  uint32_t changes = FloppyDiskChanges(0);
+
+  if (changes == Changes)
+    return;
+
+  Changes = changes;
+  Stats.invalidations++;
+
+  for (short i = 0; i < NSlots; i++) {
+    TrackSlot_t *ts = Slot[i];
+    if (ts->dirty) {
+      ts->dirty = false;
+      NDirty--;
+      Stats.discarded++;
+    }
+    ts->track = -1;
+    ts->lastUsed = 0;
+  }
+}
+
+/* Geometry of the disk is known only after the track was read. */
+static bool ReadTrack(TrackSlot_t *ts, short track) {
+  FloppyIO_t *io;
+  uint32_t missing;
+
+  (void)xQueueReceive(IOPool, &io, portMAX_DELAY);
+  missing = FloppyReadSectors(io, track, SECTOR_MASK(SECTOR_COUNT_MAX),
+                              ts->data);
+  missing &= SECTOR_MASK(io->geometry->sectors);
+  (void)xQueueSend(IOPool, &io, portMAX_DELAY);
+
+  return missing == 0;
+}
+
+/* Replace sectors selected by `mask` with data from `buf`. */
+static void Fill(TrackSlot_t *ts, uint32_t mask, const void *buf) {
+  for (short i = 0; i < SECTOR_COUNT_MAX; i++)
+    if (mask & BIT(i))
+      memcpy((void *)ts->data + i * SECTOR_SIZE, buf + i * SECTOR_SIZE,
+             SECTOR_SIZE);
+}
+
+/* Take a reference to the slot of a track and replace its sectors selected by
+ * `mask` with data from `buf`. If the track is not in the cache, it's read
+ * from the disk, unless all of its sectors are replaced. The slot is filled
+ * before other tasks waiting for it are let in, so they never see it
+ * half-done. */
+static TrackSlot_t *Acquire(short track, uint32_t mask, const void *buf) {
+  uint32_t all = SECTOR_MASK(FloppyGetGeometry(0)->sectors);
+  TrackSlot_t *ts;
+
+  configASSERT(track >= 0 && track < TRACK_COUNT);
+
+  xSemaphoreTake(CacheLock, portMAX_DELAY);
+
+  CheckDiskChange();
+
+  if ((ts = Lookup(track))) {
+    Stats.hits++;
+    ts->refcnt++;
+    ts->lastUsed = ++Clock;
+    xSemaphoreGive(CacheLock);
+
+    /* Another task is reading the track. Wait until it's done and pass
+     * the wake-up on to the next waiting task. */
+    if (ts->loading) {
+      xSemaphoreTake(ts->ready, portMAX_DELAY);
+      xSemaphoreGive(ts->ready);
+    }
+    if (ts->failed) {
+      TrackCacheRelease(ts->data);
+      return NULL;
+    }
+    Fill(ts, mask, buf);
+    return ts;
+  }
+
+  Stats.misses++;
+
+  if (!(ts = Replace())) {
+    xSemaphoreGive(CacheLock);
+    return NULL;
+  }
+
+  ts->track = track;
+  ts->refcnt = 1;
+  ts->lastUsed = ++Clock;
+  ts->loading = true;
+  ts->failed = false;
+  ts->dirty = false;
+  (void)xSemaphoreTake(ts->ready, 0);
+  xSemaphoreGive(CacheLock);
+
+  /* Other tracks can be looked up and read in the meantime. */
+  if ((mask & all) != all && !ReadTrack(ts, track)) {
+    xSemaphoreTake(CacheLock, portMAX_DELAY);
+    ts->failed = true;
+    ts->track = -1;
+    xSemaphoreGive(CacheLock);
+  }
+
+  if (!ts->failed)
+    Fill(ts, mask, buf);
+
+  ts->loading = false;
+  xSemaphoreGive(ts->ready);
+
+  if (ts->failed) {
+    TrackCacheRelease(ts->data);
+    return NULL;
+  }
+  return ts;
+}
+
+const void *TrackCacheGet(short track) {
+  TrackSlot_t *ts = Acquire(track, 0, NULL);
+  return ts ? ts->data : NULL;
+}
+
+void TrackCacheRelease(const void *data) {
+  xSemaphoreTake(CacheLock, portMAX_DELAY);
+
+  for (short i = 0; i < NSlots; i++) {
+    TrackSlot_t *ts = Slot[i];
+    if (ts->data == data) {
+      configASSERT(ts->refcnt > 0);
+      ts->refcnt--;
+      break;
+    }
+  }
+
+  Shrink();
+  xSemaphoreGive(CacheLock);
+}
+
+/* Concurrent writes to a track that is being written back mark it modified
+ * again, so it's written once more with complete data. */
+bool TrackCacheWrite(short track, uint32_t mask, const void *buf) {
+  uint32_t all = SECTOR_MASK(FloppyGetGeometry(0)->sectors);
+  TrackSlot_t *ts;
+  bool ok;
+
+  if (!(ts = Acquire(track, mask & all, buf)))
+    return false;
+
+  xSemaphoreTake(CacheLock, portMAX_DELAY);
+  Stats.writes++;
+  /* Disk could have been changed while the track was read, then the data
+   * would go to the other disk. */
+  CheckDiskChange();
+  if ((ok = ts->track == track) && !ts->dirty) {
+    ts->dirty = true;
+    NDirty++;
+  }
+  xSemaphoreGive(CacheLock);
+
+  TrackCacheRelease(ts->data);
+
+  /* Postpone write back until no more writes follow. */
+  if (ok)
+    xTaskNotifyGive(Flusher);
+  return ok;
+}
+
+/* Write back modified tracks one by one. A track that could not be written
+ * is dropped, so that its data is read from the disk again. */
+static bool Flush(void) {
+  bool ok = true;
+
+  xSemaphoreTake(FlushLock, portMAX_DELAY);
+
+  for (;;) {
+    TrackSlot_t *ts = NULL;
+    FloppyIO_t *io;
+    uint32_t changes;
+    short track;
+    bool written;
+
+    /* Data of all slots comes from the disk seen by the last CheckDiskChange,
+     * so it must not be written if another one has been inserted since. */
+    xSemaphoreTake(CacheLock, portMAX_DELAY);
+    CheckDiskChange();
+    changes = Changes;
+    for (short i = 0; i < NSlots && !ts; i++)
+      if (Slot[i]->dirty)
+        ts = Slot[i];
+    if (!ts) {
+      Shrink();
+      xSemaphoreGive(CacheLock);
+      break;
+    }
+    ts->dirty = false;
+    ts->refcnt++;
+    track = ts->track;
+    NDirty--;
+    xSemaphoreGive(CacheLock);
+
+    (void)xQueueReceive(IOPool, &io, portMAX_DELAY);
+    io->diskChanges = changes;
+    written = FloppyWriteTrack(io, track, ts->data);
+    (void)xQueueSend(IOPool, &io, portMAX_DELAY);
+
+    xSemaphoreTake(CacheLock, portMAX_DELAY);
+    if (written) {
+      Stats.flushes++;
+    } else {
+      Stats.failed++;
+      if (ts->dirty) {
+        ts->dirty = false;
+        NDirty--;
+      }
+      ts->track = -1;
+      ok = false;
+    }
+    ts->refcnt--;
+    xSemaphoreGive(CacheLock);
+  }
+
+  xSemaphoreGive(FlushLock);
+  return ok;
+}
+
+bool TrackCacheSync(void) {
+  return Flush();
+}
+
+#define FLUSH_DELAY (TRACKCACHE_FLUSH_DELAY / portTICK_PERIOD_MS)
+
+/* Each write restarts the idle delay, after which modified tracks are
+ * written back. */
+static void TrackCacheFlusher(__unused void *data) {
+  while (!Exiting) {
+    TickType_t delay = NDirty > 0 ? FLUSH_DELAY : portMAX_DELAY;
+    bool idle = ulTaskNotifyTake(pdTRUE, delay) == 0;
+
+    if (idle || Pressure || Exiting) {
+      Pressure = false;
+      (void)Flush();
+    }
+  }
+
+  xTaskNotifyGive(Killer);
+  vTaskDelete(NULL);
+}
+
+void TrackCacheGetStats(TrackCacheStats_t *stats) {
+  xSemaphoreTake(CacheLock, portMAX_DELAY);
+  *stats = Stats;
+  xSemaphoreGive(CacheLock);
+}
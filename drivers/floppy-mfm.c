@@ -4,39 +4,47 @@
 #include <custom.h>
 #include <floppy.h>
 
+#include "floppy-mfm.h"
+
 #define DEBUG 0
 
 /*
  * Amiga MFM track format:
  * http://lclevy.free.fr/adflib/adf_info.html#p22
+ *
+ * Code in this file works on memory buffers only, so it can be built for the
+ * host as well, see tools/mfmtest.c.
  */
 
-#define SECTOR_PAYLOAD 512
-
-typedef struct DiskSector {
-  uint32_t magic;
-  uint16_t sync[2];
-  struct {
-    uint8_t format;
-    uint8_t trackNum;
-    uint8_t sectorNum;
-    uint8_t sectors;
-  } info[2];
-  uint8_t sectorLabel[2][16];
-  uint32_t checksumHeader[2];
-  uint32_t checksum[2];
-  uint8_t data[2][SECTOR_PAYLOAD];
-} DiskSector_t;
-
-#define MASK 0x55555555
-#define DECODE(odd, even) (((odd)&MASK) << 1) | ((even)&MASK)
-
-void DecodeTrack(DiskTrack_t *track, DiskSector_t *sectors[SECTOR_COUNT]) {
-  int16_t secnum = SECTOR_COUNT;
-  DiskSector_t *maybeSector = (DiskSector_t *)track;
+/* Checksums cover data bits of MFM encoded longwords. */
+static uint32_t Checksum(const uint32_t *data, short n) {
+  uint32_t sum = 0;
 
   do {
-    uint16_t *data = (uint16_t *)maybeSector;
+    sum ^= *data++;
+  } while (--n);
+
+  return sum & MASK;
+}
+
+uint32_t DecodeTrack(DiskTrack_t *track, const FloppyGeometry_t *geometry,
+                     uint16_t num, DiskSector_t *sectors[]) {
+  uint16_t *data = (uint16_t *)track;
+  /* Complete sector must fit between sync marker and the end of buffer,
+   * so sector info must start before `end`. */
+  uint16_t *end =
+    (uint16_t *)((uintptr_t)track + geometry->trackSize -
+                 sizeof(DiskSector_t) + offsetof(DiskSector_t, info[0])) +
+    1;
+  uint32_t found = 0;
+  /* Word synchronized DMA starts right after a marker, which may be the last
+   * one in front of sector info, so the buffer starts as if after a marker. */
+  bool synced = true;
+
+  for (short i = 0; i < geometry->sectors; i++)
+    sectors[i] = NULL;
+
+  for (;;) {
     struct {
       uint8_t format;
       uint8_t trackNum;
@@ -45,10 +53,14 @@ void DecodeTrack(DiskTrack_t *track, DiskSector_t *sectors[SECTOR_COUNT]) {
     } info = {0};
 
     /* Find synchronization marker and move to first location after it. */
-    while (*data != DSK_SYNC)
-      data++;
-    while (*data == DSK_SYNC)
+    if (!synced)
+      while (data < end && *data != DSK_SYNC)
+        data++;
+    synced = false;
+    while (data < end && *data == DSK_SYNC)
       data++;
+    if (data >= end)
+      break;
 
     DiskSector_t *sec =
       (DiskSector_t *)((uintptr_t)data - offsetof(DiskSector_t, info[0]));
@@ -61,15 +73,26 @@ void DecodeTrack(DiskTrack_t *track, DiskSector_t *sectors[SECTOR_COUNT]) {
            (intptr_t)sec, (int)info.sectorNum, (int)info.trackNum);
 #endif
 
+    /* Header checksum covers sector info and label. */
+    if (info.format != SECTOR_FORMAT || info.trackNum != num ||
+        info.sectorNum >= geometry->sectors ||
+        Checksum((uint32_t *)sec->info, 10) !=
+          DECODE(sec->checksumHeader[0], sec->checksumHeader[1]))
+      continue;
+
     sectors[info.sectorNum] = sec;
-    maybeSector = sec + 1;
-  } while (--secnum);
+    found |= BIT(info.sectorNum);
+    data = (uint16_t *)(sec + 1);
+  }
+
+  return found;
 }
 
-void DecodeSector(DiskSector_t *sector, uint32_t *buf) {
+bool DecodeSector(DiskSector_t *sector, uint32_t *buf) {
   uint32_t *odd = (uint32_t *)sector->data[0];
   uint32_t *even = (uint32_t *)sector->data[1];
   int16_t n = SECTOR_PAYLOAD / sizeof(uint32_t) / 2;
+  uint32_t sum = 0;
 
   do {
     uint32_t odd0 = *odd++;
@@ -78,5 +101,101 @@ void DecodeSector(DiskSector_t *sector, uint32_t *buf) {
     uint32_t even1 = *even++;
     *buf++ = DECODE(odd0, even0);
     *buf++ = DECODE(odd1, even1);
+    sum ^= odd0 ^ odd1 ^ even0 ^ even1;
+  } while (--n);
+
+  return (sum & MASK) == DECODE(sector->checksum[0], sector->checksum[1]);
+}
+
+bool VerifySector(DiskSector_t *sector) {
+  short n = sizeof(sector->data) / sizeof(uint32_t);
+  return Checksum((uint32_t *)sector->data, n) ==
+         DECODE(sector->checksum[0], sector->checksum[1]);
+}
+
+/*
+ * Encoder. Longwords are split into odd and even bits, which are put into data
+ * bit positions. Clock bit is set between two data bits that are both zero,
+ * so the first one depends on the last data bit of the previous longword.
+ */
+
+static inline uint32_t *Put(uint32_t *dst, uint32_t data) {
+  *dst = AddClock(dst[-1], data);
+  return dst + 1;
+}
+
+/* Gap in front of the sectors gets partially overwritten when the end of
+ * the track wraps around, which leaves a margin for drive speed deviation. */
+DiskSector_t *EncodeGap(DiskTrack_t *track, const FloppyGeometry_t *geometry) {
+  uint32_t *gap = (uint32_t *)track;
+  short n = (geometry->trackSize - geometry->sectors * sizeof(DiskSector_t)) /
+            sizeof(uint32_t);
+
+  do {
+    *gap++ = 0xaaaaaaaa;
   } while (--n);
+
+  return (DiskSector_t *)gap;
+}
+
+/* Everything but sector data, which must be followed by EncodeData. */
+void EncodeHeader(DiskSector_t *sec, uint16_t num, short i, short n,
+                  const uint32_t *buf) {
+  /* Union lets the compiler know that both members share the storage. */
+  union {
+    struct {
+      uint8_t format;
+      uint8_t trackNum;
+      uint8_t sectorNum;
+      uint8_t sectors;
+    } info;
+    uint32_t x;
+  } u = {.info = {SECTOR_FORMAT, num, i, n - i}};
+  uint32_t x = u.x;
+  uint32_t sum = 0, hsum, dsum;
+  uint32_t *p;
+
+  for (short j = 0; j < (short)(SECTOR_PAYLOAD / sizeof(uint32_t)); j++)
+    sum ^= buf[j];
+
+  /* Checksums cover data bits of encoded longwords, label is all zeros. */
+  hsum = ODD(x) ^ EVEN(x);
+  dsum = ODD(sum) ^ EVEN(sum);
+
+  (void)Put(&sec->magic, 0);
+  sec->sync[0] = DSK_SYNC;
+  sec->sync[1] = DSK_SYNC;
+  p = (uint32_t *)sec->info;
+  p = Put(p, ODD(x));
+  p = Put(p, EVEN(x));
+  for (short j = 0; j < 8; j++)
+    p = Put(p, 0);
+  p = Put(p, ODD(hsum));
+  p = Put(p, EVEN(hsum));
+  p = Put(p, ODD(dsum));
+  (void)Put(p, EVEN(dsum));
+}
+
+static void EncodeData(DiskSector_t *sec, const uint32_t *buf) {
+  short n = SECTOR_PAYLOAD / sizeof(uint32_t);
+  uint32_t *odd = (uint32_t *)sec->data[0];
+  uint32_t *even = (uint32_t *)sec->data[1];
+
+  for (short j = 0; j < n; j++)
+    odd = Put(odd, ODD(buf[j]));
+  for (short j = 0; j < n; j++)
+    even = Put(even, EVEN(buf[j]));
+}
+
+void EncodeTrack(DiskTrack_t *track, const FloppyGeometry_t *geometry,
+                 uint16_t num, const void *buf) {
+  DiskSector_t *sec = EncodeGap(track, geometry);
+  const uint32_t *data = buf;
+  short n = geometry->sectors;
+
+  for (short i = 0; i < n; i++) {
+    EncodeHeader(&sec[i], num, i, n, data);
+    EncodeData(&sec[i], data);
+    data += SECTOR_SIZE / sizeof(uint32_t);
+  }
 }
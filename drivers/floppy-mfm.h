@@ -0,0 +1,42 @@
+#ifndef _FLOPPY_MFM_H_
+#define _FLOPPY_MFM_H_
+
+/* Sector layout and encoder parts shared by CPU and blitter MFM codecs. */
+
+#define SECTOR_PAYLOAD 512
+
+typedef struct DiskSector {
+  uint32_t magic;
+  uint16_t sync[2];
+  struct {
+    uint8_t format;
+    uint8_t trackNum;
+    uint8_t sectorNum;
+    uint8_t sectors;
+  } info[2];
+  uint8_t sectorLabel[2][16];
+  uint32_t checksumHeader[2];
+  uint32_t checksum[2];
+  uint8_t data[2][SECTOR_PAYLOAD];
+} DiskSector_t;
+
+#define MASK 0x55555555
+#define DECODE(odd, even) ((((odd)&MASK) << 1) | ((even)&MASK))
+
+#define SECTOR_FORMAT 0xff
+
+#define ODD(x) (((x) >> 1) & MASK)
+#define EVEN(x) ((x)&MASK)
+
+/* Insert clock bits between data bits, `prev` is the preceding longword. */
+static inline uint32_t AddClock(uint32_t prev, uint32_t data) {
+  return data | (~(data << 1 | data >> 1 | prev << 31) & ~MASK);
+}
+
+/* Fill the gap in front of the sectors and return the first of them. */
+DiskSector_t *EncodeGap(DiskTrack_t *track, const FloppyGeometry_t *geometry);
+/* Encode sector #i out of n of track `num` except its data. */
+void EncodeHeader(DiskSector_t *sec, uint16_t num, short i, short n,
+                  const uint32_t *buf);
+
+#endif /* !_FLOPPY_MFM_H_ */
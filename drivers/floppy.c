@@ -1,5 +1,6 @@
 #include <FreeRTOS/FreeRTOS.h>
 #include <FreeRTOS/queue.h>
+#include <FreeRTOS/semphr.h>
 
 #include <interrupt.h>
 #include <custom.h>
@@ -7,6 +8,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <floppy.h>
 
@@ -14,22 +16,117 @@
 
 #define FLOPPYIO_MAXNUM 8
 
-static CIATimer_t *FloppyTimer;
-static xTaskHandle FloppyIOTask;
-static QueueHandle_t FloppyIOQueue;
+/* Requests waiting for service together with the number of times they were
+ * passed over in favour of other requests. */
+typedef struct Pending {
+  FloppyIO_t *io;
+  short age;
+} Pending_t;
+
+typedef struct Prefetch {
+  DiskTrack_t *buffer;
+  int16_t track; /* -1 if there's no data in the buffer */
+} Prefetch_t;
+
+/*
+ * Each drive is handled by its own task, so the heads of one drive can be
+ * stepped and settle while another one transfers data. Select, step,
+ * direction and side lines as well as disk DMA are shared by all drives,
+ * hence they're guarded by DiskLock, which is held for the whole transfer.
+ */
+typedef struct Drive {
+  uint8_t selbit; /* CIAB_DSKSELn */
+  uint32_t id;    /* FLOPPY_ID_NONE if there's no drive */
+  const FloppyGeometry_t *geometry;
+  bool identify; /* a disk was inserted, so the drive must be identified */
+  xTaskHandle task;
+  QueueHandle_t queue;
+  bool exiting; /* FloppyKill requested the task to finish */
+  int16_t motorOn;
+  int16_t headDir;
+  int16_t track;
+  bool unsettled; /* heads have not settled since they were last stepped */
+  bool diskPresent;
+  volatile uint32_t diskChanges;
+  uint32_t positionTime; /* spent positioning heads for current request */
+  FloppySeekProfile_t profile;
+  FloppyStats_t stats;
+  uint32_t phase[FLOPPY_PHASES]; /* lines spent by current request */
+  FloppyHistogram_t hist[FLOPPY_PHASES];
+  Pending_t pending[FLOPPYIO_MAXNUM];
+  short npending;
+  Prefetch_t prefetched[FLOPPY_PREFETCH_MAX];
+  int16_t lastTrack;
+  TickType_t lastArrival;
+  TickType_t avgGap;
+} Drive_t;
+
+static Drive_t Drive[FLOPPY_UNITS];
+static SemaphoreHandle_t DiskLock;
+static xTaskHandle DMAOwner;
+static volatile uint32_t DMADone; /* line when DSKBLK was raised */
+static xTaskHandle Killer;
+static int16_t SideLine; /* -1 if unknown */
+static FloppyPolicy_t Policy = {
+  .prefetch = 1, .motorMin = 500, .motorMax = 4000};
+
+static const char *TaskName[FLOPPY_UNITS] = {"FloppyDF0", "FloppyDF1",
+                                             "FloppyDF2", "FloppyDF3"};
+
+static const char *PhaseName[FLOPPY_PHASES] = {
+  "queue", "spinup", "seek", "settle", "dma", "wakeup", "total"};
+
+#define PRESENT(d) ((d)->id != FLOPPY_ID_NONE)
+
+const FloppyGeometry_t FloppyGeometryDD = {.sectors = SECTOR_COUNT,
+                                           .trackSize = TRACK_SIZE};
+const FloppyGeometry_t FloppyGeometryHD = {.sectors = SECTOR_COUNT_HD,
+                                           .trackSize = TRACK_SIZE_HD};
 
 static void TrackTransferDone(__unused void *ptr) {
+  DMADone = LineCounterRead();
   /* Send notification to waiting task. */
-  vTaskNotifyGiveFromISR(FloppyIOTask, &xNeedRescheduleTask);
+  vTaskNotifyGiveFromISR(DMAOwner, &xNeedRescheduleTask);
+}
+
+/* Drives report their type as a 32-bit serial number on the ready line.
+ * Turning the motor on and off resets the drive's shift register. */
+static uint32_t ReadDriveID(short unit) {
+  uint8_t selbit = CIAB_DSKSEL0 + unit;
+  uint32_t id = 0;
+
+  BCLR(ciab.ciaprb, CIAB_DSKMOTOR);
+  BCLR(ciab.ciaprb, selbit);
+  BSET(ciab.ciaprb, selbit);
+  BSET(ciab.ciaprb, CIAB_DSKMOTOR);
+  BCLR(ciab.ciaprb, selbit);
+  BSET(ciab.ciaprb, selbit);
+
+  for (short i = 0; i < 32; i++) {
+    BCLR(ciab.ciaprb, selbit);
+    id <<= 1;
+    if (!(ciaa.ciapra & CIAF_DSKRDY))
+      id |= 1;
+    BSET(ciab.ciaprb, selbit);
+  }
+
+  return id;
 }
 
 static void FloppyReader(void *);
+static void PolicyRequestArrived(Drive_t *d);
+static void PolicyInvalidate(Drive_t *d);
 
 void FloppyInit(unsigned aFloppyIOTaskPrio) {
   printf("[Init] Floppy drive driver!\n");
 
-  FloppyTimer = AcquireTimer(TIMER_ANY);
-  configASSERT(FloppyTimer != NULL);
+  /* Delays of all drives are measured in raster lines. */
+  LineCounterInit();
+
+  DiskLock = xSemaphoreCreateBinary();
+  configASSERT(DiskLock != NULL);
+  xSemaphoreGive(DiskLock);
+  SideLine = -1;
 
   /* Set standard synchronization marker. */
   custom.dsksync = DSK_SYNC;
@@ -40,25 +137,80 @@ void FloppyInit(unsigned aFloppyIOTaskPrio) {
   /* Handler that will wake up track reader task. */
   SetIntVec(DSKBLK, TrackTransferDone, NULL);
 
-  FloppyIOQueue = xQueueCreate(FLOPPYIO_MAXNUM, sizeof(FloppyIO_t *));
-  configASSERT(FloppyIOQueue != NULL);
+  for (short unit = 0; unit < FLOPPY_UNITS; unit++) {
+    Drive_t *d = &Drive[unit];
+    uint32_t id = ReadDriveID(unit);
 
-  xTaskCreate(FloppyReader, "FloppyReader", configMINIMAL_STACK_SIZE, NULL,
-              aFloppyIOTaskPrio, &FloppyIOTask);
-  configASSERT(FloppyIOTask != NULL);
-}
+    /* Internal drive does not identify itself, but it's always there. */
+    if (unit == 0 && id == FLOPPY_ID_NONE)
+      id = FLOPPY_ID_DD;
 
-static void FloppyMotorOff(void);
+    *d = (Drive_t){.selbit = CIAB_DSKSEL0 + unit,
+                   .id = id,
+                   .geometry = id == FLOPPY_ID_HD ? &FloppyGeometryHD
+                                                  : &FloppyGeometryDD,
+                   .diskPresent = true,
+                   .profile = FloppySeekStandard,
+                   .lastTrack = -1};
 
+    if (!PRESENT(d))
+      continue;
+
+    printf("[Floppy] DF%d: drive found!\n", unit);
+
+    d->queue = xQueueCreate(FLOPPYIO_MAXNUM, sizeof(FloppyIO_t *));
+    configASSERT(d->queue != NULL);
+  }
+
+  FloppySetPolicy(&Policy);
+
+  for (short unit = 0; unit < FLOPPY_UNITS; unit++) {
+    Drive_t *d = &Drive[unit];
+    if (!PRESENT(d))
+      continue;
+    xTaskCreate(FloppyReader, TaskName[unit], configMINIMAL_STACK_SIZE, d,
+                aFloppyIOTaskPrio, &d->task);
+    configASSERT(d->task != NULL);
+  }
+}
+
+/* Drive tasks finish requests they have already received, turn the motors
+ * off and report back before their resources are released. */
 void FloppyKill(void) {
+  Killer = xTaskGetCurrentTaskHandle();
+
+  for (short unit = 0; unit < FLOPPY_UNITS; unit++) {
+    Drive_t *d = &Drive[unit];
+    FloppyIO_t *none = NULL;
+    if (PRESENT(d))
+      (void)xQueueSend(d->queue, &none, portMAX_DELAY);
+  }
+
+  for (short unit = 0; unit < FLOPPY_UNITS; unit++)
+    if (PRESENT(&Drive[unit]))
+      (void)ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+
   DisableINT(INTF_DSKBLK);
   DisableDMA(DMAF_DISK);
   ResetIntVec(DSKBLK);
-  FloppyMotorOff();
 
-  ReleaseTimer(FloppyTimer);
-  vTaskDelete(FloppyIOTask);
-  vQueueDelete(FloppyIOQueue);
+  for (short unit = 0; unit < FLOPPY_UNITS; unit++) {
+    Drive_t *d = &Drive[unit];
+
+    if (!PRESENT(d))
+      continue;
+
+    vQueueDelete(d->queue);
+
+    for (short i = 0; i < FLOPPY_PREFETCH_MAX; i++) {
+      if (d->prefetched[i].buffer)
+        vPortFree(d->prefetched[i].buffer);
+      d->prefetched[i].buffer = NULL;
+    }
+  }
+
+  vSemaphoreDelete(DiskLock);
+  LineCounterKill();
 }
 
 /******************************************************************************/
@@ -69,151 +221,659 @@ void FloppyKill(void) {
 #define OUTWARDS 0
 #define INWARDS 1
 
-static int16_t MotorOn;
-static int16_t HeadDir;
-static int16_t Track;
+/* Head positioning delays in microseconds. */
+const FloppySeekProfile_t FloppySeekStandard = {
+  .step = 3000, .reverse = 18000, .settle = 15000, .side = 100};
+/* Most drives step reliably at this rate, but some will lose track. */
+const FloppySeekProfile_t FloppySeekFast = {
+  .step = 2000, .reverse = 15000, .settle = 15000, .side = 100};
 
-#define STEP_SETTLE TIMER_MS(3)
+/* PAL raster line takes 64us. Alarm must be set at least one line ahead. */
+#define US2LINES(us) max(((uint32_t)(us) + 63) / 64, 2UL)
 
-static void StepHeads(void) {
-  BCLR(ciab.ciaprb, CIAB_DSKSTEP);
-  BSET(ciab.ciaprb, CIAB_DSKSTEP);
+/* Add lines elapsed since `start` to given phase of current request. */
+static inline void Account(Drive_t *d, FloppyPhase_t phase, uint32_t start) {
+  d->phase[phase] += LineCounterRead() - start;
+}
 
-  WaitTimerSleep(FloppyTimer, STEP_SETTLE);
+static void SeekDelay(Drive_t *d, uint16_t us) {
+  LineCounterWait(US2LINES(us));
+  d->stats.seekTime += us;
+  d->positionTime += us;
+}
 
-  Track += HeadDir;
+/* Select the drive for exclusive use of shared lines. Drive latches the motor
+ * line when it gets selected, so it has to be set up first. */
+static void LockDisk(Drive_t *d) {
+  xSemaphoreTake(DiskLock, portMAX_DELAY);
+  if (d->motorOn)
+    BCLR(ciab.ciaprb, CIAB_DSKMOTOR);
+  else
+    BSET(ciab.ciaprb, CIAB_DSKMOTOR);
+  BCLR(ciab.ciaprb, d->selbit);
 }
 
-#define DIRECTION_REVERSE_SETTLE TIMER_MS(18)
+static void UnlockDisk(Drive_t *d) {
+  BSET(ciab.ciaprb, d->selbit);
+  xSemaphoreGive(DiskLock);
+}
 
-static inline void HeadsStepDirection(int16_t inwards) {
-  if (inwards) {
+static void StepHeads(Drive_t *d) {
+  LockDisk(d);
+  if (d->headDir > 0)
     BCLR(ciab.ciaprb, CIAB_DSKDIREC);
-    HeadDir = 2;
-  } else {
+  else
     BSET(ciab.ciaprb, CIAB_DSKDIREC);
-    HeadDir = -2;
-  }
+  BCLR(ciab.ciaprb, CIAB_DSKSTEP);
+  BSET(ciab.ciaprb, CIAB_DSKSTEP);
+  UnlockDisk(d);
+
+  SeekDelay(d, d->profile.step);
 
-  WaitTimerSleep(FloppyTimer, DIRECTION_REVERSE_SETTLE);
+  d->track += d->headDir;
+  d->unsettled = true;
+
+  d->stats.steps++;
 }
 
-static inline void ChangeDiskSide(int16_t upper) {
-  if (upper) {
-    BCLR(ciab.ciaprb, CIAB_DSKSIDE);
-    Track++;
-  } else {
-    BSET(ciab.ciaprb, CIAB_DSKSIDE);
-    Track--;
-  }
+/* The drive needs some time to accept the first step in the other direction,
+ * so the delay is paid only when the direction actually changes. */
+static inline void HeadsStepDirection(Drive_t *d, int16_t inwards) {
+  int16_t dir = inwards ? 2 : -2;
+
+  if (dir == d->headDir)
+    return;
+
+  if (d->headDir)
+    d->stats.reversals++;
+
+  d->headDir = dir;
+
+  SeekDelay(d, d->profile.reverse);
 }
 
-static inline void WaitDiskReady(void) {
-  while (ciaa.ciapra & CIAF_DSKRDY)
-    continue;
+/* Side line is shared, so it's set just before the transfer. */
+static inline void ChangeDiskSide(Drive_t *d, int16_t upper) {
+  d->track = (d->track & ~1) | upper;
 }
 
-static inline int HeadsAtTrack0() {
-  return !(ciaa.ciapra & CIAF_DSKTRACK0);
+static inline bool ReadStatus(Drive_t *d, uint8_t flag) {
+  bool active;
+
+  LockDisk(d);
+  active = !(ciaa.ciapra & flag);
+  UnlockDisk(d);
+
+  return active;
 }
 
-static void FloppyMotorOn(void) {
-  if (MotorOn)
+#define HeadsAtTrack0(d) ReadStatus(d, CIAF_DSKTRACK0)
+
+/* Other drives may use the shared lines while the motor spins up. */
+#define MOTOR_POLL_US 10000
+
+static void FloppyMotorOn(Drive_t *d) {
+  uint32_t start;
+
+  if (d->motorOn)
     return;
 
-  BSET(ciab.ciaprb, CIAB_DSKSEL0);
-  BCLR(ciab.ciaprb, CIAB_DSKMOTOR);
-  BCLR(ciab.ciaprb, CIAB_DSKSEL0);
+  start = LineCounterRead();
+  d->motorOn = 1;
+  LockDisk(d);
+  UnlockDisk(d);
 
-  WaitDiskReady();
+  while (!ReadStatus(d, CIAF_DSKRDY))
+    LineCounterWait(US2LINES(MOTOR_POLL_US));
 
-  MotorOn = 1;
+  d->stats.spinups++;
+  Account(d, FLOPPY_PHASE_SPINUP, start);
 }
 
-static void FloppyMotorOff(void) {
-  if (!MotorOn)
+static void FloppyMotorOff(Drive_t *d) {
+  if (!d->motorOn)
     return;
 
-  BSET(ciab.ciaprb, CIAB_DSKSEL0);
-  BSET(ciab.ciaprb, CIAB_DSKMOTOR);
-  BCLR(ciab.ciaprb, CIAB_DSKSEL0);
+  d->motorOn = 0;
+  LockDisk(d);
+  UnlockDisk(d);
+}
+
+/* Reading the ID turns the motor off, so it's done before spinning up. */
+static void Identify(Drive_t *d) {
+  FloppyMotorOff(d);
 
-  MotorOn = 0;
+  xSemaphoreTake(DiskLock, portMAX_DELAY);
+  /* Drives without ID sequence respond with zeros, but they're DD. */
+  if (ReadDriveID(d->selbit - CIAB_DSKSEL0) == FLOPPY_ID_HD)
+    d->id = FLOPPY_ID_HD;
+  else
+    d->id = FLOPPY_ID_DD;
+  xSemaphoreGive(DiskLock);
+
+  d->geometry = d->id == FLOPPY_ID_HD ? &FloppyGeometryHD : &FloppyGeometryDD;
+  d->identify = false;
 }
 
-#define DISK_SETTLE TIMER_MS(15)
+/* Disk change line goes active when the disk is removed and stays so until
+ * the heads are stepped with a disk in the drive. */
+static void CheckDiskChange(Drive_t *d) {
+  if (!ReadStatus(d, CIAF_DSKCHANGE)) {
+    if (!d->diskPresent)
+      d->identify = true;
+    d->diskPresent = true;
+    return;
+  }
 
-static void FloppyReader(__unused void *ptr) {
-  /* Move head to track 0 */
-  FloppyMotorOn();
-  HeadsStepDirection(OUTWARDS);
-  while (!HeadsAtTrack0())
-    StepHeads();
-  HeadsStepDirection(INWARDS);
-  ChangeDiskSide(LOWER);
-  /* Now we are at well defined position */
-  Track = 0;
+  if (d->diskPresent) {
+    d->diskPresent = false;
+    d->diskChanges++;
+    PolicyInvalidate(d);
+    /* Read-ahead does not carry over to the next disk. */
+    d->lastTrack = -1;
+  }
 
-  for (;;) {
-    FloppyIO_t *io;
+  /* Try to reset the line without losing track of heads position. These steps
+   * are not a part of any seek, so they are left out of seek statistics. */
+  FloppyStats_t saved = d->stats;
+  uint32_t positionTime = d->positionTime;
 
-    if (xQueueReceive(FloppyIOQueue, &io, 1000 / portTICK_PERIOD_MS)) {
-      /* Turn the motor on. */
-      FloppyMotorOn();
+  HeadsStepDirection(d, d->track < 2);
+  StepHeads(d);
 
-      /* Switch heads if needed. */
-      if ((io->track ^ Track) & 1)
-        ChangeDiskSide(io->track & 1);
+  d->stats.steps = saved.steps;
+  d->stats.reversals = saved.reversals;
+  d->stats.seekTime = saved.seekTime;
+  d->positionTime = positionTime;
 
-      /* Travel to requested track. */
-      if (io->track != Track) {
-        HeadsStepDirection(io->track > Track);
-        while (io->track != Track)
-          StepHeads();
-      }
+  /* A disk inserted meanwhile clears the line, and it may be of other density
+   * than the one that was removed, so it must be identified before use. */
+  if (!ReadStatus(d, CIAF_DSKCHANGE)) {
+    d->diskPresent = true;
+    d->identify = true;
+  }
+}
 
-      /* Wait for the head to stabilize over the track. */
-      WaitTimerSleep(FloppyTimer, DISK_SETTLE);
+/* Request passed over that many times is serviced before any other. */
+#define MAX_AGE 8
 
-      /* Make sure the DMA for the disk is turned off. */
-      custom.dsklen = 0;
+/* Move queued requests into the pending set. Block for `timeout` ticks only if
+ * there are no requests at all. */
+static bool FetchRequests(Drive_t *d, TickType_t timeout) {
+  FloppyIO_t *io;
+
+  while (!d->exiting && d->npending < FLOPPYIO_MAXNUM &&
+         xQueueReceive(d->queue, &io, d->npending ? 0 : timeout)) {
+    if (!io) {
+      d->exiting = true;
+      break;
+    }
+    d->pending[d->npending++] = (Pending_t){.io = io, .age = 0};
+    PolicyRequestArrived(d);
+  }
+
+  return d->npending > 0;
+}
+
+/* C-SCAN: the heads sweep inwards servicing requests on the way, then jump
+ * back to the outermost requested cylinder. On the current cylinder
+ * the current side goes first, as switching sides costs nothing. */
+static FloppyIO_t *NextRequest(Drive_t *d) {
+  Pending_t *pending = d->pending;
+  short cyl = d->track >> 1;
+  short best = -1, bestKey = 0;
+  FloppyIO_t *io;
+
+  for (short i = 0; i < d->npending; i++) {
+    short track = pending[i].io->track;
+    short dist = (track >> 1) - cyl;
+    short key;
+
+    if (pending[i].age >= MAX_AGE) {
+      /* The oldest starving request goes first. */
+      key = -pending[i].age;
+    } else {
+      if (dist < 0)
+        dist += TRACK_COUNT / 2;
+      key = dist * 2 + ((track ^ d->track) & 1);
+    }
+
+    if (best < 0 || key < bestKey) {
+      best = i;
+      bestKey = key;
+    }
+  }
+
+  io = pending[best].io;
+  pending[best] = pending[--d->npending];
+
+  for (short i = 0; i < d->npending; i++)
+    pending[i].age++;
+
+  return io;
+}
+
+/* Move the heads over the track and wait for them to stabilize. Heads that
+ * have not moved since they last settled are ready right away. */
+static void SeekTrack(Drive_t *d, uint16_t track) {
+  /* Switch heads if needed. */
+  if ((track ^ d->track) & 1)
+    ChangeDiskSide(d, track & 1);
+
+  /* Travel to requested track. */
+  if (track != d->track) {
+    uint32_t start = LineCounterRead();
+    d->stats.seeks++;
+    HeadsStepDirection(d, track > d->track);
+    while (track != d->track)
+      StepHeads(d);
+    Account(d, FLOPPY_PHASE_SEEK, start);
+  }
+
+  /* Wait for the head to stabilize over the track. */
+  if (d->unsettled) {
+    uint32_t start = LineCounterRead();
+    SeekDelay(d, d->profile.settle);
+    d->unsettled = false;
+    Account(d, FLOPPY_PHASE_SETTLE, start);
+  }
+}
+
+/* Cylinders from this one inwards are written with precompensation, as bits
+ * are packed more densely there. */
+#define PRECOMP_CYLINDER 40
+
+/* Shift register still holds the last word when DMA transfer is over. */
+#define WRITE_DRAIN_LINES 2
+
+static void TransferTrack(Drive_t *d, DiskTrack_t *buffer, bool write) {
+  int16_t side = d->track & 1;
+  uint16_t dsklen = DSK_DMAEN | (d->geometry->trackSize / sizeof(int16_t));
+  uint32_t start;
+
+  LockDisk(d);
+
+  /* Make sure the DMA for the disk is turned off. */
+  custom.dsklen = 0;
 
 #if DEBUG
-      printf("[Floppy] Read track %d into %p.\n", (int)io->track, io->buffer);
+  printf("[Floppy] %s track %d %s %p.\n", write ? "Write" : "Read",
+         (int)d->track, write ? "from" : "into", buffer);
 #endif
 
-      /* Prepare for transfer. */
-      ClearIRQ(INTF_DSKBLK);
-      EnableINT(INTF_DSKBLK);
-      EnableDMA(DMAF_DISK);
+  /* Switching sides takes much less time than settling after a step. */
+  if (side != SideLine) {
+    start = LineCounterRead();
+    if (side == UPPER)
+      BCLR(ciab.ciaprb, CIAB_DSKSIDE);
+    else
+      BSET(ciab.ciaprb, CIAB_DSKSIDE);
+    SideLine = side;
+    SeekDelay(d, d->profile.side);
+    Account(d, FLOPPY_PHASE_SEEK, start);
+  }
+
+  /* Prepare for transfer. */
+  DMAOwner = xTaskGetCurrentTaskHandle();
+  ClearIRQ(INTF_DSKBLK);
+  EnableINT(INTF_DSKBLK);
+  EnableDMA(DMAF_DISK);
+
+  /* Buffer in chip memory. */
+  custom.dskpt = buffer;
+
+  /* Writing starts right away instead of waiting for synchronization marker,
+   * so the whole track gets overwritten. */
+  if (write) {
+    custom.adkcon = ADKF_WORDSYNC | ADKF_PRE560NS;
+    if ((d->track >> 1) >= PRECOMP_CYLINDER)
+      custom.adkcon = ADKF_SETCLR | ADKF_PRE140NS;
+    dsklen |= DSK_WRITE;
+  }
+
+  /* Write track size twice to initiate DMA transfer. */
+  custom.dsklen = dsklen;
+  custom.dsklen = dsklen;
+  start = LineCounterRead();
+
+  (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  d->phase[FLOPPY_PHASE_DMA] += DMADone - start;
+  Account(d, FLOPPY_PHASE_WAKEUP, DMADone);
+
+  if (write)
+    LineCounterWait(WRITE_DRAIN_LINES);
+
+  /* Disable DMA & interrupts. */
+  custom.dsklen = 0;
+  DisableINT(INTF_DSKBLK);
+  DisableDMA(DMAF_DISK);
+
+  if (write)
+    custom.adkcon = ADKF_SETCLR | ADKF_WORDSYNC;
+
+  UnlockDisk(d);
+
+  d->stats.transfers++;
+  if (write)
+    d->stats.writes++;
+}
+
+#define ReadTrack(d, buffer) TransferTrack((d), (buffer), false)
+#define WriteTrack(d, buffer) TransferTrack((d), (buffer), true)
+
+/******************************************************************************/
+
+/*
+ * Motor and read-ahead policy. While the motor is on and there are no
+ * requests, tracks following the last requested one are read into spare
+ * buffers. The motor is turned off after a delay that follows the average
+ * time between requests, so that spin-up is not paid by closely spaced ones.
+ */
+
+/* Disk change line is polled that often while the motor is off. */
+#define DISK_CHANGE_POLL (1000 / portTICK_PERIOD_MS)
+
+static void PolicyRequestArrived(Drive_t *d) {
+  TickType_t now = xTaskGetTickCount();
+  TickType_t gap = now - d->lastArrival;
+
+  d->lastArrival = now;
+  d->avgGap = (d->avgGap * 7 + gap) / 8;
+}
+
+static TickType_t PolicyMotorDelay(Drive_t *d) {
+  TickType_t lo = Policy.motorMin / portTICK_PERIOD_MS;
+  TickType_t hi = Policy.motorMax / portTICK_PERIOD_MS;
+  return min(max(d->avgGap * 2, lo), hi);
+}
+
+static void PolicyInvalidate(Drive_t *d) {
+  for (short i = 0; i < FLOPPY_PREFETCH_MAX; i++)
+    d->prefetched[i].track = -1;
+}
+
+static Prefetch_t *PolicyLookup(Drive_t *d, uint16_t track) {
+  for (short i = 0; i < FLOPPY_PREFETCH_MAX; i++) {
+    Prefetch_t *pf = &d->prefetched[i];
+    if (pf->buffer && pf->track == (int16_t)track)
+      return pf;
+  }
+  return NULL;
+}
+
+/* Choose the next track to be read ahead and the buffer for it. */
+static Prefetch_t *PolicyNextPrefetch(Drive_t *d, uint16_t *trackp) {
+  short n = min(Policy.prefetch, (short)FLOPPY_PREFETCH_MAX);
+  int16_t last = d->lastTrack;
+
+  /* Without a disk the transfer would never finish. Disk that has not been
+   * identified yet is left alone until a request comes. */
+  if (last < 0 || !d->diskPresent || d->identify)
+    return NULL;
+
+  for (short i = 1; i <= n && last + i < TRACK_COUNT; i++) {
+    uint16_t track = last + i;
+
+    if (PolicyLookup(d, track))
+      continue;
+
+    /* Reuse buffer that holds a track outside of read-ahead window. */
+    for (short j = 0; j < n; j++) {
+      Prefetch_t *pf = &d->prefetched[j];
+      if (!pf->buffer)
+        continue;
+      if (pf->track < 0 || pf->track <= last || pf->track > last + n) {
+        if (pf->track >= 0)
+          d->stats.prefetchWasted++;
+        *trackp = track;
+        return pf;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+static void HistogramAdd(FloppyHistogram_t *hist, uint32_t lines) {
+  short i = 0;
+
+  for (uint32_t n = lines; n && i < FLOPPY_HIST_BUCKETS - 1; n >>= 1)
+    i++;
+
+  hist->count[i]++;
+  hist->sum += lines;
+  hist->max = max(hist->max, lines);
+}
+
+static void ServiceRequest(Drive_t *d, FloppyIO_t *io) {
+  Prefetch_t *pf;
+
+  memset(d->phase, 0, sizeof(d->phase));
+  Account(d, FLOPPY_PHASE_QUEUE, io->sent);
+  d->positionTime = 0;
+  CheckDiskChange(d);
+  if (d->identify)
+    Identify(d);
+  FloppyMotorOn(d);
+
+  io->error = FLOPPY_OK;
+
+  if (io->cmd == CMD_WRITE) {
+    /* Track was encoded for the disk that was in the drive back then. Disk
+     * change is noticed only when the drive is polled, e.g. just above. */
+    if (io->diskChanges != d->diskChanges || io->geometry != d->geometry) {
+      io->error = FLOPPY_ERR_CHANGED;
+    } else if (ReadStatus(d, CIAF_DSKPROT)) {
+      io->error = FLOPPY_ERR_WRPROT;
+    } else {
+      if ((pf = PolicyLookup(d, io->track)))
+        pf->track = -1;
+      SeekTrack(d, io->track);
+      WriteTrack(d, io->buffer);
+    }
+  } else if ((pf = PolicyLookup(d, io->track))) {
+    memcpy(io->buffer, pf->buffer, d->geometry->trackSize);
+    pf->track = -1;
+    d->stats.prefetchHits++;
+  } else {
+    SeekTrack(d, io->track);
+    ReadTrack(d, io->buffer);
+  }
+
+  d->lastTrack = io->track;
+  io->seekTime = d->positionTime;
+  io->geometry = d->geometry;
+
+  Account(d, FLOPPY_PHASE_TOTAL, io->sent);
+  taskENTER_CRITICAL();
+  for (short i = 0; i < FLOPPY_PHASES; i++)
+    HistogramAdd(&d->hist[i], d->phase[i]);
+  taskEXIT_CRITICAL();
 
-      /* Buffer in chip memory. */
-      custom.dskpt = io->buffer;
+  /* Wake up the task that requested transfer. */
+  xQueueSend(io->replyQueue, &io, portMAX_DELAY);
+}
 
-      /* Write track size twice to initiate DMA transfer. */
-      custom.dsklen = DSK_DMAEN | (TRACK_SIZE / sizeof(int16_t));
-      custom.dsklen = DSK_DMAEN | (TRACK_SIZE / sizeof(int16_t));
+static void FloppyReader(void *data) {
+  Drive_t *d = data;
+  TickType_t idleSince = 0;
 
-      (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  /* Move head to track 0 */
+  FloppyMotorOn(d);
+  HeadsStepDirection(d, OUTWARDS);
+  while (!HeadsAtTrack0(d))
+    StepHeads(d);
+  /* Now we are at well defined position */
+  d->track = 0;
 
-      /* Disable DMA & interrupts. */
-      custom.dsklen = 0;
-      DisableINT(INTF_DSKBLK);
-      DisableDMA(DMAF_DISK);
+  for (;;) {
+    TickType_t timeout = DISK_CHANGE_POLL;
+    Prefetch_t *pf = NULL;
+    uint16_t track;
+
+    if (d->motorOn) {
+      TickType_t idle = xTaskGetTickCount() - idleSince;
+      TickType_t delay = PolicyMotorDelay(d);
+      pf = PolicyNextPrefetch(d, &track);
+      timeout = pf ? 0 : (idle < delay ? delay - idle : 0);
+    }
 
-      /* Wake up the task that requested transfer. */
-      xQueueSend(io->replyQueue, &io, portMAX_DELAY);
+    if (FetchRequests(d, timeout)) {
+      ServiceRequest(d, NextRequest(d));
+      idleSince = xTaskGetTickCount();
+    } else if (d->exiting) {
+      break;
+    } else if (pf) {
+      /* Requests that arrive in the meantime wait for one revolution. */
+      CheckDiskChange(d);
+      if (d->identify || !d->diskPresent)
+        continue;
+      SeekTrack(d, track);
+      ReadTrack(d, pf->buffer);
+      pf->track = track;
+      d->stats.prefetches++;
+    } else if (d->motorOn) {
+      FloppyMotorOff(d);
     } else {
-      FloppyMotorOff();
+      CheckDiskChange(d);
     }
   }
+
+  FloppyMotorOff(d);
+  xTaskNotifyGive(Killer);
+  vTaskDelete(NULL);
 }
 
 void FloppySendIO(FloppyIO_t *io) {
-  configASSERT(io->cmd == CMD_READ);
+  configASSERT(io->cmd == CMD_READ || io->cmd == CMD_WRITE);
+  configASSERT(io->unit < FLOPPY_UNITS && PRESENT(&Drive[io->unit]));
   configASSERT(io->track < TRACK_COUNT);
   configASSERT(io->replyQueue != NULL);
   configASSERT(io->buffer != NULL);
 
-  xQueueSend(FloppyIOQueue, &io, portMAX_DELAY);
+  io->sent = LineCounterRead();
+  xQueueSend(Drive[io->unit].queue, &io, portMAX_DELAY);
+}
+
+uint32_t FloppyDriveID(short unit) {
+  return Drive[unit].id;
+}
+
+const FloppyGeometry_t *FloppyGetGeometry(short unit) {
+  return Drive[unit].geometry;
+}
+
+void FloppyGetStats(short unit, FloppyStats_t *stats) {
+  taskENTER_CRITICAL();
+  *stats = Drive[unit].stats;
+  taskEXIT_CRITICAL();
+}
+
+void FloppyGetHistograms(short unit, FloppyHistogram_t hist[FLOPPY_PHASES]) {
+  taskENTER_CRITICAL();
+  memcpy(hist, Drive[unit].hist, sizeof(Drive[unit].hist));
+  taskEXIT_CRITICAL();
+}
+
+void FloppyResetHistograms(short unit) {
+  taskENTER_CRITICAL();
+  memset(Drive[unit].hist, 0, sizeof(Drive[unit].hist));
+  taskEXIT_CRITICAL();
+}
+
+void FloppyDumpHistograms(File_t *f, short unit) {
+  FloppyHistogram_t hist[FLOPPY_PHASES];
+
+  FloppyGetHistograms(unit, hist);
+
+  for (short i = 0; i < FLOPPY_PHASES; i++) {
+    FilePrintf(f, "[FloppyHist] %d %s %d %d", (int)unit, PhaseName[i],
+               (int)hist[i].sum, (int)hist[i].max);
+    for (short j = 0; j < FLOPPY_HIST_BUCKETS; j++)
+      FilePrintf(f, " %d", (int)hist[i].count[j]);
+    FilePrintf(f, "\n");
+  }
+}
+
+uint32_t FloppyDiskChanges(short unit) {
+  return Drive[unit].diskChanges;
+}
+
+uint32_t FloppyReadSectors(FloppyIO_t *io, uint16_t track, uint32_t mask,
+                           void *buf) {
+  DiskSector_t *sectors[SECTOR_COUNT_MAX];
+
+  for (short retry = 0; mask && retry <= FLOPPY_RETRIES; retry++) {
+    FloppyIO_t *done;
+    uint32_t found;
+
+    if (retry > 0)
+      Drive[io->unit].stats.rereads++;
+
+    io->cmd = CMD_READ;
+    io->track = track;
+    FloppySendIO(io);
+    (void)xQueueReceive(io->replyQueue, &done, portMAX_DELAY);
+
+    /* Only requested sectors are decoded and verified. */
+    found = DecodeTrack(io->buffer, io->geometry, track, sectors) & mask;
+    for (short i = 0; i < io->geometry->sectors; i++)
+      if ((found & BIT(i)) && DecodeSector(sectors[i], buf + i * SECTOR_SIZE))
+        mask &= ~BIT(i);
+
+    /* Sectors beyond the geometry of the disk won't show up. */
+    if (!(mask & SECTOR_MASK(io->geometry->sectors)))
+      break;
+  }
+
+  return mask;
+}
+
+bool FloppyWriteTrack(FloppyIO_t *io, uint16_t track, const void *buf) {
+  FloppyIO_t *done;
+
+  io->geometry = FloppyGetGeometry(io->unit);
+  EncodeTrack(io->buffer, io->geometry, track, buf);
+
+  io->cmd = CMD_WRITE;
+  io->track = track;
+  FloppySendIO(io);
+  (void)xQueueReceive(io->replyQueue, &done, portMAX_DELAY);
+
+  return io->error == FLOPPY_OK;
+}
+
+/* Buffers for read-ahead are allocated on demand and kept until FloppyKill. */
+void FloppySetPolicy(const FloppyPolicy_t *policy) {
+  short n = min(policy->prefetch, (short)FLOPPY_PREFETCH_MAX);
+
+  for (short unit = 0; unit < FLOPPY_UNITS; unit++) {
+    Drive_t *d = &Drive[unit];
+
+    if (!PRESENT(d))
+      continue;
+
+    for (short i = 0; i < n; i++) {
+      Prefetch_t *pf = &d->prefetched[i];
+      if (!pf->buffer) {
+        DiskTrack_t *buffer = AllocTrack();
+        configASSERT(buffer != NULL);
+        taskENTER_CRITICAL();
+        pf->buffer = buffer;
+        pf->track = -1;
+        taskEXIT_CRITICAL();
+      }
+    }
+  }
+
+  taskENTER_CRITICAL();
+  Policy = *policy;
+  taskEXIT_CRITICAL();
+}
+
+void FloppySetSeekProfile(short unit, const FloppySeekProfile_t *profile) {
+  taskENTER_CRITICAL();
+  Drive[unit].profile = *profile;
+  taskEXIT_CRITICAL();
 }
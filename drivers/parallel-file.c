@@ -0,0 +1,60 @@
+#include <parallel.h>
+#include <file.h>
+
+static long ParallelFileRead(File_t *f, char *buf, size_t nbyte);
+static long ParallelFileWrite(File_t *f, const char *buf, size_t nbyte);
+static long ParallelFileSeek(File_t *f, long offset, int whence);
+static void ParallelClose(File_t *f);
+
+static FileOps_t ParOps = {.read = (FileRead_t)ParallelFileRead,
+                           .write = (FileWrite_t)ParallelFileWrite,
+                           .seek = (FileSeek_t)ParallelFileSeek,
+                           .close = (FileClose_t)ParallelClose};
+
+File_t *ParallelOpen(void) {
+  static File_t f = {.ops = &ParOps};
+
+  if (++f.usecount == 1)
+    ParallelInit();
+  return &f;
+}
+
+static void ParallelClose(File_t *f) {
+  if (--f->usecount == 0)
+    ParallelKill();
+}
+
+static long ParallelFileWrite(__unused File_t *f, const char *buf,
+                              size_t nbyte) {
+  ParallelWrite(buf, nbyte);
+  return nbyte;
+}
+
+/* Reads are exact, so that stream can be consumed by loaders (e.g. hunk
+ * loader) that expect regular file semantics. */
+static long ParallelFileRead(File_t *f, char *buf, size_t nbyte) {
+  long n = ParallelReadExact(buf, nbyte, portMAX_DELAY);
+  f->offset += n;
+  return n;
+}
+
+/* Only skipping forward is possible. */
+static long ParallelFileSeek(File_t *f, long offset, int whence) {
+  char buf[32];
+
+  if (whence == SEEK_SET)
+    offset -= f->offset;
+  else if (whence != SEEK_CUR)
+    return -1;
+
+  if (offset < 0)
+    return -1;
+
+  while (offset > 0) {
+    long n = min(offset, (long)sizeof(buf));
+    f->offset += ParallelReadExact(buf, n, portMAX_DELAY);
+    offset -= n;
+  }
+
+  return f->offset;
+}
@@ -0,0 +1,201 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+#include <FreeRTOS/semphr.h>
+
+#include <cia.h>
+#include <interrupt.h>
+#include <ringbuf.h>
+#include <stdio.h>
+
+#include <parallel.h>
+
+#define BUFLEN 1024
+
+/* Transmit buffer: task is the producer, ACK interrupt is the consumer.
+ * Receive buffer: ACK interrupt is the producer, task is the consumer. */
+static uint8_t SendData[BUFLEN];
+static uint8_t RecvData[BUFLEN];
+static RingBuf_t SendBuf;
+static RingBuf_t RecvBuf;
+
+/* Set when no byte awaits acknowledgment and the port is in input mode. */
+static volatile bool SendIdle;
+
+/* Locks serialize writers and readers, while waiters are woken up by ACK
+ * interrupt handler, just like in serial driver. */
+static SemaphoreHandle_t SendLock;
+static SemaphoreHandle_t RecvLock;
+static volatile TaskHandle_t SendWaiter;
+static volatile TaskHandle_t RecvWaiter;
+
+/* Peer that does not acknowledge a byte for that long is considered gone. */
+#define ACK_TIMEOUT (configTICK_RATE_HZ / 2)
+
+#define PortOutput() (ciaa.ciaddrb = 0xff)
+#define PortInput() (ciaa.ciaddrb = 0)
+#define PortIsOutput() (ciaa.ciaddrb != 0)
+
+static void ParallelIntHandler(CIA_t cia) {
+  if (!SampleICR(cia, CIAICRF_FLG))
+    return;
+
+  if (PortIsOutput()) {
+    /* Peer acknowledged previous byte, so send next one. */
+    int cSend = RingBufGet(&SendBuf);
+    if (cSend < 0) {
+      PortInput();
+      SendIdle = true;
+    } else {
+      cia->ciaprb = cSend;
+    }
+    if (SendWaiter) {
+      vTaskNotifyGiveFromISR(SendWaiter, &xNeedRescheduleTask);
+      SendWaiter = NULL;
+    }
+  } else {
+    /* Peer strobed a byte. Reading the port acknowledges it.
+     * Byte is dropped if the buffer is full. */
+    (void)RingBufPut(&RecvBuf, cia->ciaprb);
+    if (RecvWaiter) {
+      vTaskNotifyGiveFromISR(RecvWaiter, &xNeedRescheduleTask);
+      RecvWaiter = NULL;
+    }
+  }
+}
+
+INTSERVER_DEFINE(ParallelInt, 0, (ISR_t)ParallelIntHandler, (void *)CIAA);
+
+void ParallelInit(void) {
+  printf("[Init] Parallel port driver!\n");
+
+  RingBufInit(&SendBuf, SendData, BUFLEN);
+  RingBufInit(&RecvBuf, RecvData, BUFLEN);
+  SendIdle = true;
+
+  SendLock = xSemaphoreCreateBinary();
+  RecvLock = xSemaphoreCreateBinary();
+  configASSERT(SendLock != NULL && RecvLock != NULL);
+  xSemaphoreGive(SendLock);
+  xSemaphoreGive(RecvLock);
+
+  PortInput();
+
+  AddIntServer(PortsChain, ParallelInt);
+  (void)SampleICR(CIAA, CIAICRF_FLG);
+  WriteICR(CIAA, CIAICRF_SETCLR | CIAICRF_FLG);
+}
+
+void ParallelKill(void) {
+  /* Let the peer acknowledge pending data, unless it stopped responding. */
+  while (!SendIdle) {
+    uint16_t used = RingBufUsed(&SendBuf);
+    WaitFor(SendWaiter, !SendIdle, ACK_TIMEOUT);
+    if (!SendIdle && RingBufUsed(&SendBuf) == used)
+      break;
+  }
+
+  WriteICR(CIAA, CIAICRF_FLG);
+  RemIntServer(ParallelInt);
+
+  /* Bytes that were not acknowledged are dropped, ParallelInit resets
+   * the buffers. */
+  PortInput();
+
+  vSemaphoreDelete(SendLock);
+  vSemaphoreDelete(RecvLock);
+}
+
+/* Interrupt handler sends the rest, once the peer acknowledges first byte.
+ * With interrupts disabled we are the only consumer of SendBuf. */
+static void SendKick(void) {
+  taskENTER_CRITICAL();
+  if (SendIdle) {
+    int cSend = RingBufGet(&SendBuf);
+    if (cSend >= 0) {
+      SendIdle = false;
+      PortOutput();
+      ciaa.ciaprb = cSend;
+    }
+  }
+  taskEXIT_CRITICAL();
+}
+
+void ParallelWrite(const void *buf, size_t nbyte) {
+  const uint8_t *data = buf;
+
+  xSemaphoreTake(SendLock, portMAX_DELAY);
+
+  while (nbyte > 0) {
+    size_t n = RingBufWrite(&SendBuf, data, nbyte);
+    data += n;
+    nbyte -= n;
+    if (n)
+      SendKick();
+    if (nbyte)
+      WaitFor(SendWaiter, RingBufFull(&SendBuf), portMAX_DELAY);
+  }
+
+  xSemaphoreGive(SendLock);
+}
+
+/* Reliable transfers may only happen 3 or more E-cycles basis, see
+ * bootcons-putc.S. Reading BUSY line and the dummy read take two E-cycles,
+ * the write takes the third one. */
+void ParallelWriteBulk(const void *buf, size_t nbyte) {
+  const uint8_t *data = buf;
+
+  xSemaphoreTake(SendLock, portMAX_DELAY);
+
+  while (!SendIdle)
+    WaitFor(SendWaiter, !SendIdle, portMAX_DELAY);
+
+  /* ACK pulses are of no interest while we poll BUSY line. */
+  WriteICR(CIAA, CIAICRF_FLG);
+  PortOutput();
+
+  while (nbyte--) {
+    while (ciab.ciapra & CIAF_PRTRBUSY)
+      continue;
+    (void)ciab.ciapra;
+    ciaa.ciaprb = *data++;
+  }
+
+  while (ciab.ciapra & CIAF_PRTRBUSY)
+    continue;
+  PortInput();
+
+  (void)SampleICR(CIAA, CIAICRF_FLG);
+  WriteICR(CIAA, CIAICRF_SETCLR | CIAICRF_FLG);
+
+  xSemaphoreGive(SendLock);
+}
+
+static size_t RecvGeneric(void *buf, size_t nbyte, bool exact,
+                          TickType_t ticks) {
+  uint8_t *data = buf;
+  size_t done = 0;
+  TimeOut_t timeout;
+
+  xSemaphoreTake(RecvLock, portMAX_DELAY);
+  vTaskSetTimeOutState(&timeout);
+
+  while (done < nbyte) {
+    done += RingBufRead(&RecvBuf, data + done, nbyte - done);
+    if (done == nbyte || (!exact && done > 0))
+      break;
+    if (xTaskCheckForTimeOut(&timeout, &ticks))
+      break;
+    WaitFor(RecvWaiter, RingBufEmpty(&RecvBuf), ticks);
+  }
+
+  xSemaphoreGive(RecvLock);
+  return done;
+}
+
+size_t ParallelRead(void *buf, size_t nbyte) {
+  return RecvGeneric(buf, nbyte, false, portMAX_DELAY);
+}
+
+size_t ParallelReadExact(void *buf, size_t nbyte, TickType_t timeout) {
+  return RecvGeneric(buf, nbyte, true, timeout);
+}
@@ -0,0 +1,200 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <ringbuf.h>
+#include <string.h>
+
+#include <pipe.h>
+
+#define PIPE_MAXSIZE 32768
+
+typedef struct Pipe {
+  File_t reader;
+  File_t writer;
+  RingBuf_t rb;
+  uint16_t trigger;
+  volatile TaskHandle_t rwaiter; /* reader waiting for data */
+  volatile TaskHandle_t wwaiter; /* writer waiting for free space */
+  volatile bool rclosed;
+  volatile bool wclosed;
+  uint8_t data[];
+} Pipe_t;
+
+#define READER2PIPE(f) ((Pipe_t *)(f))
+#define WRITER2PIPE(f) ((Pipe_t *)((char *)(f)-offsetof(Pipe_t, writer)))
+
+static long PipeRead(File_t *f, void *buf, size_t nbyte);
+static long PipeWrite(File_t *f, const void *buf, size_t nbyte);
+static void PipeCloseReader(File_t *f);
+static void PipeCloseWriter(File_t *f);
+
+static FileOps_t ReaderOps = {.read = PipeRead, .close = PipeCloseReader};
+static FileOps_t WriterOps = {.write = PipeWrite, .close = PipeCloseWriter};
+
+bool PipeOpen(size_t size, File_t **readerp, File_t **writerp) {
+  size_t rbsize = 1;
+  Pipe_t *p;
+
+  while (rbsize < size)
+    rbsize <<= 1;
+
+  if (rbsize > PIPE_MAXSIZE || !(p = pvPortMalloc(sizeof(Pipe_t) + rbsize)))
+    return false;
+
+  memset(p, 0, sizeof(Pipe_t));
+  RingBufInit(&p->rb, p->data, rbsize);
+
+  p->reader.ops = &ReaderOps;
+  p->reader.usecount = 1;
+  p->writer.ops = &WriterOps;
+  p->writer.usecount = 1;
+  p->trigger = 1;
+
+  *readerp = &p->reader;
+  *writerp = &p->writer;
+  return true;
+}
+
+void PipeSetTrigger(File_t *f, size_t level) {
+  Pipe_t *p = READER2PIPE(f);
+  p->trigger = max(min(level, (size_t)p->rb.size), (size_t)1);
+}
+
+/* Task side counterpart of vTaskNotifyGiveFromISR used by interrupt handler
+ * writing to the pipe. */
+static void Wake(volatile TaskHandle_t *waiterp) {
+  TaskHandle_t waiter;
+
+  taskENTER_CRITICAL();
+  waiter = *waiterp;
+  *waiterp = NULL;
+  taskEXIT_CRITICAL();
+
+  if (waiter)
+    xTaskNotifyGive(waiter);
+}
+
+static void WakeReader(Pipe_t *p) {
+  if (RingBufUsed(&p->rb) >= p->trigger)
+    Wake(&p->rwaiter);
+}
+
+static long PipeRead(File_t *f, void *buf, size_t nbyte) {
+  Pipe_t *p = READER2PIPE(f);
+
+  if (nbyte == 0)
+    return 0;
+
+  for (;;) {
+    /* Check before reading, so that data written just before the writer was
+     * closed is not lost. */
+    bool eof = p->wclosed;
+    size_t n = RingBufRead(&p->rb, buf, nbyte);
+    if (n > 0) {
+      Wake(&p->wwaiter);
+      return n;
+    }
+    if (eof)
+      return 0;
+    WaitFor(p->rwaiter, RingBufUsed(&p->rb) < p->trigger && !p->wclosed,
+            portMAX_DELAY);
+  }
+}
+
+static long PipeWrite(File_t *f, const void *buf, size_t nbyte) {
+  Pipe_t *p = WRITER2PIPE(f);
+  const char *data = buf;
+  size_t done = 0;
+
+  while (done < nbyte && !p->rclosed) {
+    size_t n = RingBufWrite(&p->rb, data + done, nbyte - done);
+    if (n > 0) {
+      done += n;
+      WakeReader(p);
+    } else {
+      WaitFor(p->wwaiter, RingBufFull(&p->rb) && !p->rclosed, portMAX_DELAY);
+    }
+  }
+
+  /* Nobody is going to read the data. */
+  if (done == 0 && nbyte > 0)
+    return -1;
+  return done;
+}
+
+size_t PipeWriteFromISR(File_t *f, const void *buf, size_t nbyte) {
+  Pipe_t *p = WRITER2PIPE(f);
+  size_t n = RingBufWrite(&p->rb, buf, nbyte);
+
+  if (p->rwaiter && RingBufUsed(&p->rb) >= p->trigger) {
+    vTaskNotifyGiveFromISR(p->rwaiter, &xNeedRescheduleTask);
+    p->rwaiter = NULL;
+  }
+
+  return n;
+}
+
+long PipeReserve(File_t *f, void **bufp, size_t nbyte) {
+  Pipe_t *p = WRITER2PIPE(f);
+
+  while (!p->rclosed) {
+    size_t n = RingBufReserve(&p->rb, bufp);
+    if (n > 0)
+      return min(n, nbyte);
+    WaitFor(p->wwaiter, RingBufFull(&p->rb) && !p->rclosed, portMAX_DELAY);
+  }
+
+  return -1;
+}
+
+void PipeCommit(File_t *f, size_t nbyte) {
+  Pipe_t *p = WRITER2PIPE(f);
+  RingBufCommit(&p->rb, nbyte);
+  WakeReader(p);
+}
+
+static void PipeCloseReader(File_t *f) {
+  Pipe_t *p = READER2PIPE(f);
+  TaskHandle_t waiter;
+  bool release;
+
+  if (--f->usecount > 0)
+    return;
+
+  /* Once the other end is closed, it may release the pipe at any time. */
+  taskENTER_CRITICAL();
+  p->rclosed = true;
+  release = p->wclosed;
+  /* Writer may be waiting for space that will never be freed. */
+  waiter = p->wwaiter;
+  p->wwaiter = NULL;
+  taskEXIT_CRITICAL();
+
+  if (release)
+    vPortFree(p);
+  else if (waiter)
+    xTaskNotifyGive(waiter);
+}
+
+static void PipeCloseWriter(File_t *f) {
+  Pipe_t *p = WRITER2PIPE(f);
+  TaskHandle_t waiter;
+  bool release;
+
+  if (--f->usecount > 0)
+    return;
+
+  /* Once the other end is closed, it may release the pipe at any time. */
+  taskENTER_CRITICAL();
+  p->wclosed = true;
+  release = p->rclosed;
+  /* Reader may be waiting for data that will never come. */
+  waiter = p->rwaiter;
+  p->rwaiter = NULL;
+  taskEXIT_CRITICAL();
+
+  if (release)
+    vPortFree(p);
+  else if (waiter)
+    xTaskNotifyGive(waiter);
+}
@@ -0,0 +1,305 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/queue.h>
+
+#include <string.h>
+
+#include <readahead.h>
+
+typedef struct RaBuf {
+  FileReq_t req; /* background read request */
+  char *data;
+  long offset; /* file offset of the first byte in the buffer */
+  long length; /* number of valid bytes */
+  long size;   /* number of bytes requested */
+  bool pending;
+  bool used; /* some data was passed to the reader */
+} RaBuf_t;
+
+typedef struct RaFile {
+  File_t f;
+  File_t *base;
+  ReadAheadParams_t params;
+  size_t bufsize;
+  size_t window; /* current read size */
+  long lastEnd;  /* where previous read ended */
+  short seq;     /* number of sequential reads so far */
+  RaBuf_t buf[2];
+  RaBuf_t *last; /* buffer that served previous read */
+  QueueHandle_t replyQ;
+  ReadAheadStats_t stats;
+} RaFile_t;
+
+static long RaRead(RaFile_t *ra, void *buf, size_t nbyte);
+static long RaSeek(RaFile_t *ra, long offset, int whence);
+static void RaClose(RaFile_t *ra);
+static long RaMap(RaFile_t *ra, const void **bufp, size_t nbyte);
+
+static FileOps_t RaOps = {.read = (FileRead_t)RaRead,
+                          .seek = (FileSeek_t)RaSeek,
+                          .close = (FileClose_t)RaClose,
+                          .map = (FileMap_t)RaMap};
+
+static size_t RoundUp(size_t n, size_t align) {
+  return (n + align - 1) / align * align;
+}
+
+static void RaFree(RaFile_t *ra) {
+  for (short i = 0; i < 2; i++)
+    if (ra->buf[i].data)
+      vPortFree(ra->buf[i].data);
+  if (ra->replyQ)
+    vQueueDelete(ra->replyQ);
+  vPortFree(ra);
+}
+
+File_t *ReadAheadOpen(File_t *base, const ReadAheadParams_t *params) {
+  size_t align = max(params->align, (size_t)1);
+  RaFile_t *ra;
+
+  if (!(ra = pvPortMalloc(sizeof(RaFile_t))))
+    return NULL;
+
+  memset(ra, 0, sizeof(RaFile_t));
+  ra->f.ops = &RaOps;
+  ra->f.usecount = 1;
+  ra->f.offset = base->offset;
+  ra->base = base;
+  ra->bufsize = RoundUp(max(params->maxwin, align), align);
+  ra->lastEnd = -1;
+
+  ra->replyQ = xQueueCreate(1, sizeof(FileReq_t *));
+  for (short i = 0; i < 2; i++)
+    ra->buf[i].data = pvPortMalloc(ra->bufsize);
+
+  if (!ra->replyQ || !ra->buf[0].data || !ra->buf[1].data) {
+    RaFree(ra);
+    return NULL;
+  }
+
+  ReadAheadSetParams(&ra->f, params);
+  return &ra->f;
+}
+
+void ReadAheadSetParams(File_t *f, const ReadAheadParams_t *params) {
+  RaFile_t *ra = (RaFile_t *)f;
+  size_t align = max(params->align, (size_t)1);
+
+  ra->params = *params;
+  ra->params.align = align;
+  ra->params.minwin = min(RoundUp(max(params->minwin, align), align),
+                          ra->bufsize);
+  ra->params.maxwin = min(RoundUp(params->maxwin, align), ra->bufsize);
+  ra->params.maxwin = max(ra->params.maxwin, ra->params.minwin);
+  ra->window = ra->params.minwin;
+  ra->seq = 0;
+}
+
+void ReadAheadGetStats(File_t *f, ReadAheadStats_t *stats) {
+  *stats = ((RaFile_t *)f)->stats;
+}
+
+/* There's at most one background read at a time. */
+static void WaitPending(RaFile_t *ra) {
+  for (short i = 0; i < 2; i++) {
+    RaBuf_t *rb = &ra->buf[i];
+    if (rb->pending) {
+      (void)FileWaitAsync(ra->replyQ);
+      rb->pending = false;
+      rb->length = max(rb->req.result, 0L);
+    }
+  }
+}
+
+static void Drop(RaFile_t *ra, RaBuf_t *rb) {
+  if (rb->length > 0 && !rb->used)
+    ra->stats.wasted++;
+  rb->length = 0;
+}
+
+static long Fill(RaFile_t *ra, RaBuf_t *rb, long start, size_t len) {
+  long n = -1;
+
+  WaitPending(ra);
+  Drop(ra, rb);
+
+  if (FileSeek(ra->base, start, SEEK_SET) >= 0)
+    n = FileRead(ra->base, rb->data, len);
+
+  rb->offset = start;
+  rb->length = max(n, 0L);
+  rb->size = len;
+  rb->used = false;
+  return n;
+}
+
+/* Reader has just consumed data from `cur`, so read the window that follows
+ * it into the other buffer. */
+static void Prefetch(RaFile_t *ra, RaBuf_t *cur) {
+  RaBuf_t *next = (cur == &ra->buf[0]) ? &ra->buf[1] : &ra->buf[0];
+  long start = cur->offset + cur->length;
+
+  if (!ra->params.async || ra->seq < ra->params.trigger)
+    return;
+
+  /* Short read means we've reached end of file. */
+  if (cur->pending || cur->length < cur->size)
+    return;
+
+  if (next->pending || (next->length > 0 && next->offset == start))
+    return;
+
+  Drop(ra, next);
+
+  if (FileSeek(ra->base, start, SEEK_SET) < 0)
+    return;
+
+  next->offset = start;
+  next->size = ra->window;
+  next->used = false;
+  next->req = (FileReq_t){
+    .buf = next->data, .nbyte = ra->window, .replyQueue = ra->replyQ};
+  next->pending = FileReadAsync(ra->base, &next->req);
+  if (next->pending)
+    ra->stats.prefetches++;
+}
+
+static RaBuf_t *Lookup(RaFile_t *ra, long off) {
+  for (short i = 0; i < 2; i++) {
+    RaBuf_t *rb = &ra->buf[i];
+    if (rb->pending && off >= rb->offset && off < rb->offset + rb->size)
+      WaitPending(ra);
+    if (off >= rb->offset && off < rb->offset + rb->length)
+      return rb;
+  }
+  return NULL;
+}
+
+/* Sequential access grows the window, random access shrinks it back. */
+static void Detect(RaFile_t *ra, long off) {
+  if (off == ra->lastEnd) {
+    if (ra->seq < ra->params.trigger)
+      ra->seq++;
+    else
+      ra->window = min(ra->window * 2, ra->params.maxwin);
+  } else {
+    ra->seq = 0;
+    ra->window = ra->params.minwin;
+  }
+}
+
+/* Find up to `left` bytes of data at given offset, reading them from the
+ * underlying file if needed. Returns 0 at the end of file and -1 on error. */
+static long NextSpan(RaFile_t *ra, long off, size_t left, const char **spanp) {
+  RaBuf_t *rb = Lookup(ra, off);
+  RaBuf_t *last = ra->last;
+
+  if (rb) {
+    ra->stats.hits++;
+  } else if (last && last->length < last->size &&
+             off >= last->offset + last->length) {
+    /* Previous read has already hit the end of file. */
+    return 0;
+  } else {
+    size_t align = ra->params.align;
+    long start = off - off % align;
+    size_t len = RoundUp(off - start + left, align);
+
+    ra->stats.misses++;
+    rb = (ra->last == &ra->buf[0]) ? &ra->buf[1] : &ra->buf[0];
+    if (Fill(ra, rb, start, min(max(len, ra->window), ra->bufsize)) < 0)
+      return -1;
+    if (off >= rb->offset + rb->length)
+      return 0;
+  }
+
+  rb->used = true;
+  ra->last = rb;
+  *spanp = rb->data + (off - rb->offset);
+  return min((long)left, rb->offset + rb->length - off);
+}
+
+static long RaRead(RaFile_t *ra, void *buf, size_t nbyte) {
+  char *data = buf;
+  long off = ra->f.offset;
+  long done = 0;
+
+  Detect(ra, off);
+
+  while (done < (long)nbyte) {
+    size_t left = nbyte - done;
+    const char *span;
+    long n;
+
+    if (left >= ra->bufsize && !Lookup(ra, off)) {
+      /* Too much to be buffered, so read it directly. */
+      WaitPending(ra);
+      ra->stats.bypassed++;
+      n = -1;
+      if (FileSeek(ra->base, off, SEEK_SET) >= 0)
+        n = FileRead(ra->base, data + done, left);
+    } else if ((n = NextSpan(ra, off, left, &span)) > 0) {
+      memcpy(data + done, span, n);
+    }
+
+    if (n <= 0) {
+      if (n < 0 && done == 0)
+        done = -1;
+      break;
+    }
+
+    done += n;
+    off += n;
+  }
+
+  ra->f.offset = ra->lastEnd = off;
+  if (ra->last)
+    Prefetch(ra, ra->last);
+  return done;
+}
+
+/* Lend the buffer. Prefetching uses the other one, so it stays intact. */
+static long RaMap(RaFile_t *ra, const void **bufp, size_t nbyte) {
+  long off = ra->f.offset;
+  const char *span;
+  long n;
+
+  Detect(ra, off);
+
+  if ((n = NextSpan(ra, off, min(nbyte, ra->bufsize), &span)) > 0) {
+    *bufp = span;
+    off += n;
+  }
+
+  ra->f.offset = ra->lastEnd = off;
+  if (ra->last)
+    Prefetch(ra, ra->last);
+  return n;
+}
+
+static long RaSeek(RaFile_t *ra, long offset, int whence) {
+  if (whence == SEEK_CUR) {
+    offset += ra->f.offset;
+  } else if (whence == SEEK_END) {
+    WaitPending(ra);
+    if (FileSeek(ra->base, offset, SEEK_END) < 0)
+      return -1;
+    offset = ra->base->offset;
+  } else if (whence != SEEK_SET) {
+    return -1;
+  }
+
+  if (offset < 0)
+    return -1;
+
+  ra->f.offset = offset;
+  return offset;
+}
+
+static void RaClose(RaFile_t *ra) {
+  if (--ra->f.usecount > 0)
+    return;
+
+  WaitPending(ra);
+  FileClose(ra->base);
+  RaFree(ra);
+}
@@ -0,0 +1,409 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+#include <FreeRTOS/queue.h>
+#include <FreeRTOS/semphr.h>
+
+#include <serlink.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <remote.h>
+
+/*
+ * Protocol carried by serial link (all values are big endian):
+ *
+ * Request:
+ *  [BYTE] #cmd    : REQ_OPEN, REQ_READ or REQ_CLOSE
+ *  [BYTE] #tag    : copied into the reply
+ *  [WORD] #handle : file handle (READ & CLOSE)
+ *  [LONG] #offset : file offset (READ)
+ *  [WORD] #length : number of bytes to read (READ) or name length (OPEN)
+ *  ...    name of the file (OPEN)
+ *
+ * Reply (sent in the same order as requests were received):
+ *  [BYTE] #cmd    : copied from the request
+ *  [BYTE] #tag    : copied from the request
+ *  [WORD] #length : number of data bytes that follow the reply
+ *  [LONG] #value  : handle (OPEN), bytes read (READ), or -1 on error
+ *  ...    file size (OPEN) or file contents (READ)
+ */
+
+#define REQ_OPEN 'O'
+#define REQ_READ 'R'
+#define REQ_CLOSE 'C'
+
+#define NAME_MAX 64
+
+/* Largest read request that fits into #length field. */
+#define READ_MAX 0xffff
+
+typedef struct Request {
+  uint8_t cmd;
+  uint8_t tag;
+  uint16_t handle;
+  uint32_t offset;
+  uint16_t length;
+} Request_t;
+
+typedef struct Reply {
+  uint8_t cmd;
+  uint8_t tag;
+  uint16_t length;
+  int32_t value;
+} Reply_t;
+
+/* Request that awaits a reply from the host. */
+typedef struct Pending {
+  uint8_t tag;
+  volatile bool done;
+  long value; /* copied from the reply */
+  void *data; /* where to store data that follows the reply */
+  size_t size;
+  xTaskHandle waiter; /* task blocked in WaitReply */
+  FileReq_t *async;   /* asynchronous read completed by the reply */
+} Pending_t;
+
+typedef struct Block {
+  Pending_t req; /* req.value is the number of valid bytes */
+  uint32_t offset;
+  char data[REMOTE_BLKSIZE];
+} Block_t;
+
+typedef struct RemoteFile {
+  File_t f;
+  uint16_t handle;
+  uint32_t size;
+  /* Blocks starting at `first` cover `count` consecutive blocks of the file
+   * beginning at `start`. Some of them may still be in flight. */
+  uint32_t start;
+  short first;
+  short count;
+  Block_t block[REMOTE_READAHEAD];
+  Pending_t areq; /* asynchronous read in progress */
+} RemoteFile_t;
+
+static long RemoteRead(RemoteFile_t *rf, void *buf, size_t nbyte);
+static long RemoteSeek(RemoteFile_t *rf, long offset, int whence);
+static void RemoteClose(RemoteFile_t *rf);
+static long RemoteMap(RemoteFile_t *rf, const void **bufp, size_t nbyte);
+static bool RemoteReadAsync(RemoteFile_t *rf, FileReq_t *req);
+
+static FileOps_t RemoteOps = {.read = (FileRead_t)RemoteRead,
+                              .seek = (FileSeek_t)RemoteSeek,
+                              .close = (FileClose_t)RemoteClose,
+                              .map = (FileMap_t)RemoteMap,
+                              .readasync = (FileReadAsync_t)RemoteReadAsync};
+
+static File_t *Link;
+static SemaphoreHandle_t RemoteLock;
+
+/* Requests in the order they were sent, consumed by the receiver task. */
+#define MAXPENDING 16
+static QueueHandle_t PendQueue;
+static xTaskHandle RecvTask;
+static uint8_t NextTag;
+
+static void RemoteReceiver(void *);
+
+void RemoteInit(unsigned baud, unsigned aLinkTaskPrio) {
+  Link = SerLinkOpen(baud, aLinkTaskPrio);
+
+  RemoteLock = xSemaphoreCreateBinary();
+  configASSERT(RemoteLock != NULL);
+  xSemaphoreGive(RemoteLock);
+
+  PendQueue = xQueueCreate(MAXPENDING, sizeof(Pending_t *));
+  configASSERT(PendQueue != NULL);
+
+  xTaskCreate(RemoteReceiver, "RemoteRecv", configMINIMAL_STACK_SIZE, NULL,
+              aLinkTaskPrio, &RecvTask);
+  configASSERT(RecvTask != NULL);
+}
+
+/* All files must be closed, so the receiver waits for next request. */
+void RemoteKill(void) {
+  vTaskDelete(RecvTask);
+  vQueueDelete(PendQueue);
+  vSemaphoreDelete(RemoteLock);
+  FileClose(Link);
+}
+
+static void LinkReadExact(void *buf, size_t nbyte) {
+  char *data = buf;
+
+  while (nbyte > 0) {
+    long n = FileRead(Link, data, nbyte);
+    data += n;
+    nbyte -= n;
+  }
+}
+
+static void LinkSkip(size_t nbyte) {
+  char buf[32];
+
+  while (nbyte > 0) {
+    size_t n = min(nbyte, sizeof(buf));
+    LinkReadExact(buf, n);
+    nbyte -= n;
+  }
+}
+
+/* Mark request as done and wake up the task waiting for it. The request may
+ * be gone as soon as it's done, so it must not be touched afterwards. */
+static void CompleteRequest(Pending_t *req) {
+  FileReq_t *async = req->async;
+  xTaskHandle waiter;
+
+  if (async) {
+    async->result = req->value;
+    if (req->value > 0)
+      async->file->offset += req->value;
+  }
+
+  vTaskSuspendAll();
+  waiter = req->waiter;
+  req->done = true;
+  if (waiter)
+    xTaskNotifyGive(waiter);
+  (void)xTaskResumeAll();
+
+  if (async)
+    (void)xQueueSend(async->replyQueue, &async, portMAX_DELAY);
+}
+
+/* Replies arrive in the same order as requests were sent. */
+static void RemoteReceiver(__unused void *ptr) {
+  for (;;) {
+    Pending_t *req;
+    Reply_t reply;
+    size_t n;
+
+    (void)xQueueReceive(PendQueue, &req, portMAX_DELAY);
+
+    LinkReadExact(&reply, sizeof(reply));
+    configASSERT(reply.tag == req->tag);
+
+    n = min((size_t)reply.length, req->size);
+    LinkReadExact(req->data, n);
+    LinkSkip(reply.length - n);
+
+    req->value = reply.value;
+    CompleteRequest(req);
+  }
+}
+
+static void WaitReply(Pending_t *req) {
+  taskENTER_CRITICAL();
+  req->waiter = xTaskGetCurrentTaskHandle();
+  taskEXIT_CRITICAL();
+
+  while (!req->done)
+    (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+static void SendRequest(Pending_t *req, uint8_t cmd, uint16_t handle,
+                        uint32_t offset, uint16_t length, const char *name) {
+  struct {
+    Request_t hdr;
+    char name[NAME_MAX];
+  } msg;
+  size_t size = sizeof(Request_t);
+
+  req->tag = NextTag++;
+  req->done = false;
+  req->waiter = NULL;
+
+  msg.hdr = (Request_t){.cmd = cmd,
+                        .tag = req->tag,
+                        .handle = handle,
+                        .offset = offset,
+                        .length = length};
+  if (name) {
+    memcpy(msg.name, name, length);
+    size += length;
+  }
+
+  /* Blocks if too many requests await replies. */
+  (void)xQueueSend(PendQueue, &req, portMAX_DELAY);
+
+  /* Send whole request at once, so it goes in a single frame. */
+  FileWrite(Link, &msg, size);
+}
+
+File_t *RemoteOpen(const char *name) {
+  size_t length = strlen(name);
+  RemoteFile_t *rf;
+  uint32_t size;
+  Pending_t req = {.data = &size, .size = sizeof(size)};
+
+  if (length > NAME_MAX)
+    return NULL;
+
+  if (!(rf = pvPortMalloc(sizeof(RemoteFile_t))))
+    return NULL;
+
+  xSemaphoreTake(RemoteLock, portMAX_DELAY);
+  SendRequest(&req, REQ_OPEN, 0, 0, length, name);
+  WaitReply(&req);
+  xSemaphoreGive(RemoteLock);
+
+  if (req.value < 0) {
+    vPortFree(rf);
+    return NULL;
+  }
+
+  memset(rf, 0, sizeof(RemoteFile_t));
+  rf->f.ops = &RemoteOps;
+  rf->f.usecount = 1;
+  rf->handle = req.value;
+  rf->size = size;
+  for (short i = 0; i < REMOTE_READAHEAD; i++)
+    rf->block[i].req.done = true;
+  rf->areq.done = true;
+  return &rf->f;
+}
+
+static void RemoteClose(RemoteFile_t *rf) {
+  Pending_t req = {.data = NULL, .size = 0};
+
+  xSemaphoreTake(RemoteLock, portMAX_DELAY);
+  /* Block buffers must not be freed while data is being received into them. */
+  for (short i = 0; i < REMOTE_READAHEAD; i++)
+    WaitReply(&rf->block[i].req);
+  WaitReply(&rf->areq);
+  SendRequest(&req, REQ_CLOSE, rf->handle, 0, 0, NULL);
+  WaitReply(&req);
+  xSemaphoreGive(RemoteLock);
+
+  vPortFree(rf);
+}
+
+/* Return block that contains data at given offset. Blocks in front of it are
+ * requested ahead, so the host streams them while we consume this one. */
+static Block_t *FetchBlock(RemoteFile_t *rf, uint32_t offset) {
+  uint32_t start = offset & -REMOTE_BLKSIZE;
+  uint32_t end = rf->start + rf->count * REMOTE_BLKSIZE;
+  Block_t *blk;
+
+  /* Drop blocks behind the one we need, or all of them after a seek. */
+  if (rf->count > 0 && start >= rf->start && start < end) {
+    short skip = (start - rf->start) / REMOTE_BLKSIZE;
+    rf->first = (rf->first + skip) % REMOTE_READAHEAD;
+    rf->count -= skip;
+  } else {
+    rf->count = 0;
+  }
+  rf->start = start;
+
+  while (rf->count < REMOTE_READAHEAD) {
+    uint32_t next = start + rf->count * REMOTE_BLKSIZE;
+    if (next >= rf->size)
+      break;
+    blk = &rf->block[(rf->first + rf->count) % REMOTE_READAHEAD];
+    /* Dropped block may still be in flight. */
+    WaitReply(&blk->req);
+    blk->offset = next;
+    blk->req.data = blk->data;
+    blk->req.size = REMOTE_BLKSIZE;
+    SendRequest(&blk->req, REQ_READ, rf->handle, next, REMOTE_BLKSIZE, NULL);
+    rf->count++;
+  }
+
+  blk = &rf->block[rf->first];
+  WaitReply(&blk->req);
+  return blk;
+}
+
+/* Find up to `nbyte` bytes of data at current position and advance it.
+ * Returns 0 at the end of file and -1 if the host failed to read data. */
+static long NextSpan(RemoteFile_t *rf, const char **datap, size_t nbyte) {
+  Block_t *blk;
+  long skip, n;
+
+  if ((uint32_t)rf->f.offset >= rf->size)
+    return 0;
+
+  blk = FetchBlock(rf, rf->f.offset);
+  skip = rf->f.offset - blk->offset;
+
+  if (blk->req.value < 0)
+    return -1;
+
+  /* Host returned less than expected, i.e. file has shrunk. */
+  if (blk->req.value <= skip)
+    return 0;
+
+  n = min((long)nbyte, blk->req.value - skip);
+  *datap = blk->data + skip;
+  rf->f.offset += n;
+  return n;
+}
+
+static long RemoteRead(RemoteFile_t *rf, void *buf, size_t nbyte) {
+  char *data = buf;
+  long done = 0;
+
+  xSemaphoreTake(RemoteLock, portMAX_DELAY);
+
+  while (done < (long)nbyte) {
+    const char *span;
+    long n = NextSpan(rf, &span, nbyte - done);
+    if (n <= 0) {
+      if (n < 0 && done == 0)
+        done = -1;
+      break;
+    }
+    memcpy(data + done, span, n);
+    done += n;
+  }
+
+  xSemaphoreGive(RemoteLock);
+  return done;
+}
+
+/* Lend a part of block buffer. It stays intact until the next operation. */
+static long RemoteMap(RemoteFile_t *rf, const void **bufp, size_t nbyte) {
+  const char *span;
+  long n;
+
+  xSemaphoreTake(RemoteLock, portMAX_DELAY);
+  if ((n = NextSpan(rf, &span, nbyte)) > 0)
+    *bufp = span;
+  xSemaphoreGive(RemoteLock);
+  return n;
+}
+
+/* Data is received by the receiver task straight into the caller's buffer,
+ * so the reader can process other data while the host sends it. */
+static bool RemoteReadAsync(RemoteFile_t *rf, FileReq_t *req) {
+  uint32_t offset = rf->f.offset;
+
+  if (offset >= rf->size || req->nbyte == 0) {
+    req->result = 0;
+    return xQueueSend(req->replyQueue, &req, portMAX_DELAY);
+  }
+
+  xSemaphoreTake(RemoteLock, portMAX_DELAY);
+  rf->areq.data = req->buf;
+  rf->areq.size = min(req->nbyte, (size_t)READ_MAX);
+  rf->areq.async = req;
+  SendRequest(&rf->areq, REQ_READ, rf->handle, offset, rf->areq.size, NULL);
+  xSemaphoreGive(RemoteLock);
+  return true;
+}
+
+/* Does not involve interaction with the host. */
+static long RemoteSeek(RemoteFile_t *rf, long offset, int whence) {
+  if (whence == SEEK_CUR)
+    offset += rf->f.offset;
+  else if (whence == SEEK_END)
+    offset += rf->size;
+  else if (whence != SEEK_SET)
+    return -1;
+
+  if (offset < 0)
+    return -1;
+
+  rf->f.offset = offset;
+  return offset;
+}
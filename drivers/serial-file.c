@@ -1,12 +1,12 @@
 #include <serial.h>
 #include <file.h>
 
-static long SerialRead(File_t *f, char *buf, size_t nbyte);
-static long SerialWrite(File_t *f, const char *buf, size_t nbyte);
+static long SerialFileRead(File_t *f, char *buf, size_t nbyte);
+static long SerialFileWrite(File_t *f, const char *buf, size_t nbyte);
 static void SerialClose(File_t *f);
 
-static FileOps_t SerOps = {.read = (FileRead_t)SerialRead,
-                           .write = (FileWrite_t)SerialWrite,
+static FileOps_t SerOps = {.read = (FileRead_t)SerialFileRead,
+                           .write = (FileWrite_t)SerialFileWrite,
                            .close = (FileClose_t)SerialClose};
 
 File_t *SerialOpen(unsigned baud) {
@@ -22,18 +22,31 @@ static void SerialClose(File_t *f) {
     SerialKill();
 }
 
-static long SerialWrite(__unused File_t *f, const char *buf, size_t nbyte) {
-  for (size_t i = 0; i < nbyte; i++)
-    SerialPutChar(*buf++);
+static long SerialFileWrite(__unused File_t *f, const char *buf,
+                            size_t nbyte) {
+  SerialWrite(buf, nbyte);
   return nbyte;
 }
 
-static long SerialRead(__unused File_t *f, char *buf, size_t nbyte) {
-  size_t i = 0;
-  while (i < nbyte) {
-    buf[i] = SerialGetChar();
-    if (buf[i++] == '\n')
-      break;
+static SerialReadMode_t ReadMode = SER_READ_UNTIL;
+static char ReadDelim = '\n';
+static TickType_t ReadTimeout = portMAX_DELAY;
+
+void SerialSetReadMode(SerialReadMode_t mode, char delim, TickType_t timeout) {
+  ReadMode = mode;
+  ReadDelim = delim;
+  ReadTimeout = timeout;
+}
+
+static long SerialFileRead(__unused File_t *f, char *buf, size_t nbyte) {
+  switch (ReadMode) {
+    case SER_READ_AVAIL:
+      return SerialReadAvail(buf, nbyte);
+    case SER_READ_EXACT:
+      return SerialReadExact(buf, nbyte, ReadTimeout);
+    case SER_READ_UNTIL:
+      return SerialReadUntil(buf, nbyte, ReadDelim, ReadTimeout);
+    default:
+      return SerialRead(buf, nbyte);
   }
-  return i;
 }
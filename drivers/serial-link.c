@@ -0,0 +1,347 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+#include <FreeRTOS/queue.h>
+#include <FreeRTOS/semphr.h>
+#include <FreeRTOS/stream_buffer.h>
+
+#include <serial.h>
+#include <string.h>
+
+#include <serlink.h>
+
+/*
+ * Frame layout (before SLIP encoding):
+ *  [BYTE] #type : FRAME_DATA or FRAME_ACK
+ *  [BYTE] #seq  : sequence number of data frame, or the sequence number of
+ *                 data frame the receiver expects next (cumulative ack)
+ *  ...    payload (data frames only, up to SERLINK_MTU bytes)
+ *  [WORD] #crc  : CRC-16/CCITT of all preceding bytes (big endian)
+ */
+
+#define FRAME_DATA 'D'
+#define FRAME_ACK 'A'
+
+#define FRAME_HDR 2
+#define FRAME_CRC 2
+#define FRAME_MAX (FRAME_HDR + SERLINK_MTU + FRAME_CRC)
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+/* Received data waiting to be read. */
+#define RECVBUF_SIZE 1024
+
+/* Sequence numbers wrap around at 256, so window slot is seq % WINDOW. */
+#if (256 % SERLINK_WINDOW) != 0 || SERLINK_WINDOW > 128
+#error "SERLINK_WINDOW must be a power of two not greater than 128!"
+#endif
+
+typedef struct Frame {
+  uint16_t length; /* payload length */
+  uint8_t data[FRAME_MAX];
+} Frame_t;
+
+static uint16_t CrcTable[256];
+
+static xTaskHandle LinkTask;
+static SemaphoreHandle_t LinkDone;  /* given by link task before it exits */
+static volatile bool LinkQuit;
+
+static SemaphoreHandle_t SendLock;  /* whole frames go into serial port */
+static QueueHandle_t SendCredits;   /* one item for each free window slot */
+static StreamBufferHandle_t RecvData;
+
+/* Sender state: Next is advanced by writer, Base by link task. */
+static Frame_t Window[SERLINK_WINDOW];
+static volatile uint8_t SendBase; /* oldest unacknowledged frame */
+static volatile uint8_t SendNext; /* sequence number of next frame */
+static volatile TickType_t SendTime; /* last time the timer was restarted */
+static TickType_t Timeout;          /* retransmission timeout in ticks */
+
+/* Receiver state: sequence number of next expected data frame. */
+static uint8_t RecvNext;
+
+static SerLinkStats_t Stats;
+
+static void CrcInit(void) {
+  for (int i = 0; i < 256; i++) {
+    uint16_t crc = i << 8;
+    for (int j = 0; j < 8; j++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    CrcTable[i] = crc;
+  }
+}
+
+/* CRC over data followed by its big endian CRC yields zero. */
+static uint16_t Crc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xffff;
+  while (len--)
+    crc = (crc << 8) ^ CrcTable[(crc >> 8) ^ *data++];
+  return crc;
+}
+
+static size_t FrameSeal(uint8_t *frame, size_t len) {
+  uint16_t crc = Crc16(frame, len);
+  frame[len++] = crc >> 8;
+  frame[len++] = crc;
+  return len;
+}
+
+/* Encode frame with SLIP and push it into serial port in small chunks. */
+static void SendFrame(const uint8_t *frame, size_t len) {
+  uint8_t buf[64];
+  size_t n = 0;
+
+  xSemaphoreTake(SendLock, portMAX_DELAY);
+
+  /* Leading END terminates any garbage the receiver might have got. */
+  buf[n++] = SLIP_END;
+  while (len--) {
+    uint8_t c = *frame++;
+    if (n >= sizeof(buf) - 2) {
+      SerialWriteRaw(buf, n);
+      n = 0;
+    }
+    if (c == SLIP_END) {
+      buf[n++] = SLIP_ESC;
+      buf[n++] = SLIP_ESC_END;
+    } else if (c == SLIP_ESC) {
+      buf[n++] = SLIP_ESC;
+      buf[n++] = SLIP_ESC_ESC;
+    } else {
+      buf[n++] = c;
+    }
+  }
+  buf[n++] = SLIP_END;
+  SerialWriteRaw(buf, n);
+
+  xSemaphoreGive(SendLock);
+}
+
+static void SendAck(void) {
+  uint8_t frame[FRAME_HDR + FRAME_CRC] = {FRAME_ACK, RecvNext};
+  SendFrame(frame, FrameSeal(frame, FRAME_HDR));
+}
+
+static void RecvAck(uint8_t ack) {
+  uint8_t count = ack - SendBase;
+  uint8_t pending = SendNext - SendBase;
+  static const uint8_t credit = 0;
+
+  /* Duplicate or bogus acknowledgment. */
+  if (count == 0 || count > pending)
+    return;
+
+  while (count--) {
+    Stats.acked += Window[SendBase % SERLINK_WINDOW].length;
+    SendBase++;
+    (void)xQueueSend(SendCredits, &credit, 0);
+  }
+  SendTime = xTaskGetTickCount();
+}
+
+static void RecvFrame(uint8_t *frame, size_t len) {
+  if (len < FRAME_HDR + FRAME_CRC || Crc16(frame, len) != 0) {
+    Stats.badcrc++;
+    return;
+  }
+
+  len -= FRAME_HDR + FRAME_CRC;
+
+  if (frame[0] == FRAME_ACK) {
+    RecvAck(frame[1]);
+  } else if (frame[0] == FRAME_DATA) {
+    /* Frame that does not fit into receive buffer is dropped, so that
+     * the peer will send it again when the reader makes some space. */
+    if (frame[1] == RecvNext &&
+        xStreamBufferSpacesAvailable(RecvData) >= len) {
+      (void)xStreamBufferSend(RecvData, frame + FRAME_HDR, len, 0);
+      Stats.received += len;
+      RecvNext++;
+    } else {
+      Stats.rejected++;
+    }
+    SendAck();
+  }
+}
+
+/* Go-back-N: when timer expires send again all unacknowledged frames. */
+static void CheckTimeout(void) {
+  uint8_t seq = SendBase;
+  uint8_t next = SendNext;
+
+  if (seq == next || xTaskGetTickCount() - SendTime < Timeout)
+    return;
+
+  for (; seq != next; seq++) {
+    Frame_t *frame = &Window[seq % SERLINK_WINDOW];
+    SendFrame(frame->data, FRAME_HDR + frame->length + FRAME_CRC);
+    Stats.sent++;
+    Stats.resent++;
+  }
+  SendTime = xTaskGetTickCount();
+}
+
+static void LinkReceiver(__unused void *ptr) {
+  static uint8_t frame[FRAME_MAX];
+  TickType_t poll = max(Timeout / 2, (TickType_t)1);
+  size_t len = 0;
+  bool escape = false;
+  bool overflow = false;
+
+  while (!LinkQuit) {
+    uint8_t buf[64];
+    size_t n = SerialReadUntil(buf, sizeof(buf), SLIP_END, poll);
+
+    for (size_t i = 0; i < n; i++) {
+      uint8_t c = buf[i];
+
+      if (c == SLIP_END) {
+        if (len > 0 && !overflow)
+          RecvFrame(frame, len);
+        len = 0;
+        escape = false;
+        overflow = false;
+        continue;
+      }
+
+      if (c == SLIP_ESC) {
+        escape = true;
+        continue;
+      }
+
+      if (escape) {
+        if (c == SLIP_ESC_END)
+          c = SLIP_END;
+        else if (c == SLIP_ESC_ESC)
+          c = SLIP_ESC;
+        escape = false;
+      }
+
+      if (len < FRAME_MAX)
+        frame[len++] = c;
+      else
+        overflow = true;
+    }
+
+    CheckTimeout();
+  }
+
+  xSemaphoreGive(LinkDone);
+  vTaskDelete(NULL);
+}
+
+/******************************************************************************/
+
+static long SerLinkRead(File_t *f, char *buf, size_t nbyte);
+static long SerLinkWrite(File_t *f, const char *buf, size_t nbyte);
+static void SerLinkClose(File_t *f);
+
+static FileOps_t SerLinkOps = {.read = (FileRead_t)SerLinkRead,
+                               .write = (FileWrite_t)SerLinkWrite,
+                               .close = (FileClose_t)SerLinkClose};
+
+static File_t SerLinkFile = {.ops = &SerLinkOps};
+
+File_t *SerLinkOpen(unsigned baud, unsigned aLinkTaskPrio) {
+  static const uint8_t credit = 0;
+  File_t *f = &SerLinkFile;
+
+  if (++f->usecount > 1)
+    return f;
+
+  SerialInit(baud);
+  CrcInit();
+
+  SendBase = SendNext = RecvNext = 0;
+  Stats = (SerLinkStats_t){0};
+  LinkQuit = false;
+
+  /* Time to send the whole window twice at given baud rate (10 bits per
+   * character), plus a couple of ticks to let the peer respond. */
+  Timeout = 2 * SERLINK_WINDOW * FRAME_MAX * 10 * configTICK_RATE_HZ / baud + 2;
+
+  SendLock = xSemaphoreCreateBinary();
+  LinkDone = xSemaphoreCreateBinary();
+  SendCredits = xQueueCreate(SERLINK_WINDOW, sizeof(uint8_t));
+  RecvData = xStreamBufferCreate(RECVBUF_SIZE, 1);
+  configASSERT(SendLock != NULL && LinkDone != NULL);
+  configASSERT(SendCredits != NULL && RecvData != NULL);
+
+  xSemaphoreGive(SendLock);
+  for (int i = 0; i < SERLINK_WINDOW; i++)
+    (void)xQueueSend(SendCredits, &credit, 0);
+
+  xTaskCreate(LinkReceiver, "SerLink", configMINIMAL_STACK_SIZE, NULL,
+              aLinkTaskPrio, &LinkTask);
+  configASSERT(LinkTask != NULL);
+
+  return f;
+}
+
+static void SerLinkClose(File_t *f) {
+  uint8_t credit;
+
+  if (--f->usecount > 0)
+    return;
+
+  /* Wait until all frames get acknowledged, but do not hang forever
+   * if the peer went away. */
+  for (int i = 0; i < SERLINK_WINDOW; i++)
+    (void)xQueueReceive(SendCredits, &credit, 16 * Timeout);
+
+  LinkQuit = true;
+  xSemaphoreTake(LinkDone, portMAX_DELAY);
+
+  vStreamBufferDelete(RecvData);
+  vQueueDelete(SendCredits);
+  vSemaphoreDelete(LinkDone);
+  vSemaphoreDelete(SendLock);
+
+  SerialKill();
+}
+
+static long SerLinkWrite(__unused File_t *f, const char *buf, size_t nbyte) {
+  size_t done = 0;
+
+  while (done < nbyte) {
+    size_t n = min(nbyte - done, (size_t)SERLINK_MTU);
+    uint8_t seq = SendNext;
+    Frame_t *frame = &Window[seq % SERLINK_WINDOW];
+    uint8_t credit;
+
+    /* Block until there's a free slot in the window. */
+    (void)xQueueReceive(SendCredits, &credit, portMAX_DELAY);
+
+    frame->data[0] = FRAME_DATA;
+    frame->data[1] = seq;
+    memcpy(frame->data + FRAME_HDR, buf + done, n);
+    frame->length = n;
+    (void)FrameSeal(frame->data, FRAME_HDR + n);
+
+    /* Frame must be complete before link task can retransmit it. */
+    taskENTER_CRITICAL();
+    if (SendBase == seq)
+      SendTime = xTaskGetTickCount();
+    SendNext = seq + 1;
+    taskEXIT_CRITICAL();
+
+    SendFrame(frame->data, FRAME_HDR + n + FRAME_CRC);
+    Stats.sent++;
+    done += n;
+  }
+
+  return done;
+}
+
+static long SerLinkRead(__unused File_t *f, char *buf, size_t nbyte) {
+  return xStreamBufferReceive(RecvData, buf, nbyte, portMAX_DELAY);
+}
+
+void SerLinkGetStats(SerLinkStats_t *stats) {
+  taskENTER_CRITICAL();
+  *stats = Stats;
+  taskEXIT_CRITICAL();
+}
@@ -1,26 +1,55 @@
 #include <FreeRTOS/FreeRTOS.h>
-#include <FreeRTOS/queue.h>
+#include <FreeRTOS/task.h>
+#include <FreeRTOS/semphr.h>
 
 #include <custom.h>
 #include <interrupt.h>
+#include <ringbuf.h>
 #include <stdio.h>
 
 #include <serial.h>
 
 #define CLOCK 3546895
-#define QUEUELEN 64
+#define BUFLEN 256
 
-static QueueHandle_t SendQ;
-static QueueHandle_t RecvQ;
+/* Transmit buffer: task is the producer, TBE interrupt is the consumer.
+ * Receive buffer: RBF interrupt is the producer, task is the consumer. */
+static uint8_t SendData[BUFLEN];
+static uint8_t RecvData[BUFLEN];
+static RingBuf_t SendBuf;
+static RingBuf_t RecvBuf;
+
+/* Set when transmitter went idle and must be kicked by the producer. */
+static volatile bool SendIdle;
+
+/* Ring buffers have single producer and consumer on the task side,
+ * so concurrent writers and readers are serialized with these. */
+static SemaphoreHandle_t SendLock;
+static SemaphoreHandle_t RecvLock;
+
+/* Tasks waiting for free space in SendBuf or data in RecvBuf. */
+static volatile TaskHandle_t SendWaiter;
+static volatile TaskHandle_t RecvWaiter;
+
+/* Receiver statistics updated by RBF interrupt handler. */
+static SerialStats_t Stats;
 
 #define SendByte(byte)                                                         \
   { custom.serdat = (uint16_t)(byte) | (uint16_t)0x100; }
 
 static void SendIntHandler(__unused void *ptr) {
   /* Send one byte into the wire. */
-  uint8_t cSend;
-  if (xQueueReceiveFromISR(SendQ, &cSend, &xNeedRescheduleTask))
-    SendByte(cSend);
+  int cSend = RingBufGet(&SendBuf);
+  if (cSend < 0) {
+    SendIdle = true;
+    return;
+  }
+  SendByte(cSend);
+  /* Wake up the task waiting for buffer space (full -> non-full). */
+  if (SendWaiter) {
+    vTaskNotifyGiveFromISR(SendWaiter, &xNeedRescheduleTask);
+    SendWaiter = NULL;
+  }
 }
 
 static void RecvIntHandler(__unused void *ptr) {
@@ -28,9 +57,25 @@ static void RecvIntHandler(__unused void *ptr) {
   uint16_t code = custom.serdatr;
   if ((code & SERDATF_RBF) == 0)
     return;
-  /* Send one byte to waiting task. */
-  char cRecv = code;
-  (void)xQueueSendFromISR(RecvQ, (void *)&cRecv, &xNeedRescheduleTask);
+  if (code & SERDATF_OVRUN)
+    Stats.overruns++;
+  /* Stop bit must be set, otherwise it's a framing error. */
+  if (!(code & SERDATF_STP8))
+    Stats.framing++;
+  /* Byte is dropped if the buffer is full. */
+  if (RingBufPut(&RecvBuf, code)) {
+    uint16_t used = RingBufUsed(&RecvBuf);
+    Stats.received++;
+    if (used > Stats.highwater)
+      Stats.highwater = used;
+  } else {
+    Stats.dropped++;
+  }
+  /* Wake up the task waiting for data (empty -> non-empty). */
+  if (RecvWaiter) {
+    vTaskNotifyGiveFromISR(RecvWaiter, &xNeedRescheduleTask);
+    RecvWaiter = NULL;
+  }
 }
 
 void SerialInit(unsigned baud) {
@@ -38,8 +83,16 @@ void SerialInit(unsigned baud) {
 
   custom.serper = CLOCK / baud - 1;
 
-  RecvQ = xQueueCreate(QUEUELEN, sizeof(char));
-  SendQ = xQueueCreate(QUEUELEN, sizeof(char));
+  RingBufInit(&RecvBuf, RecvData, BUFLEN);
+  RingBufInit(&SendBuf, SendData, BUFLEN);
+  SendIdle = true;
+  Stats = (SerialStats_t){0};
+
+  SendLock = xSemaphoreCreateBinary();
+  RecvLock = xSemaphoreCreateBinary();
+  configASSERT(SendLock != NULL && RecvLock != NULL);
+  xSemaphoreGive(SendLock);
+  xSemaphoreGive(RecvLock);
 
   SetIntVec(TBE, SendIntHandler, NULL);
   SetIntVec(RBF, RecvIntHandler, NULL);
@@ -49,36 +102,135 @@ void SerialInit(unsigned baud) {
 }
 
 void SerialKill(void) {
+  /* Let the transmitter drain pending data. */
+  while (!RingBufEmpty(&SendBuf) || !(custom.serdatr & SERDATF_TSRE))
+    continue;
+
   DisableINT(INTF_TBE | INTF_RBF);
   ResetIntVec(TBE);
   ResetIntVec(RBF);
 
-  vQueueDelete(RecvQ);
-  vQueueDelete(SendQ);
+  vSemaphoreDelete(SendLock);
+  vSemaphoreDelete(RecvLock);
 }
 
-static void TriggerSend(uint8_t cSend) {
-  taskENTER_CRITICAL();
-  /* Checking if sending queue and serdat register are empty. */
-  if (uxQueueMessagesWaiting(SendQ) == 0 && custom.serdatr & SERDATF_TBE) {
-    SendByte(cSend);
-  } else {
-    uint8_t data = cSend;
-    (void)xQueueSend(SendQ, &data, portMAX_DELAY);
+static void SendSpan(const uint8_t *buf, size_t nbyte) {
+  while (nbyte > 0) {
+    size_t n = RingBufWrite(&SendBuf, buf, nbyte);
+    buf += n;
+    nbyte -= n;
+    /* Transmitter is idle, so make it call SendIntHandler. */
+    if (n && SendIdle) {
+      SendIdle = false;
+      CauseIRQ(INTF_TBE);
+    }
+    if (nbyte)
+      WaitFor(SendWaiter, RingBufFull(&SendBuf), portMAX_DELAY);
+  }
+}
+
+void SerialWrite(const void *buf, size_t nbyte) {
+  static const uint8_t CRLF[2] = {'\n', '\r'};
+  const uint8_t *data = buf;
+
+  xSemaphoreTake(SendLock, portMAX_DELAY);
+
+  /* Copy data in spans, but translate each '\n' into "\n\r". */
+  while (nbyte > 0) {
+    size_t n = 0;
+    while (n < nbyte && data[n] != '\n')
+      n++;
+    SendSpan(data, n);
+    if (n < nbyte) {
+      SendSpan(CRLF, 2);
+      n++;
+    }
+    data += n;
+    nbyte -= n;
   }
+
+  xSemaphoreGive(SendLock);
+}
+
+void SerialWriteRaw(const void *buf, size_t nbyte) {
+  xSemaphoreTake(SendLock, portMAX_DELAY);
+  SendSpan(buf, nbyte);
+  xSemaphoreGive(SendLock);
+}
+
+/* Wait for some data in receive buffer. Returns false on timeout. */
+static bool RecvWait(TimeOut_t *timeout, TickType_t *ticks) {
+  while (RingBufEmpty(&RecvBuf)) {
+    if (xTaskCheckForTimeOut(timeout, ticks))
+      return false;
+    WaitFor(RecvWaiter, RingBufEmpty(&RecvBuf), *ticks);
+  }
+  return true;
+}
+
+static size_t RecvGeneric(void *buf, size_t nbyte, SerialReadMode_t mode,
+                          char delim, TickType_t ticks) {
+  uint8_t *data = buf;
+  size_t done = 0;
+  TimeOut_t timeout;
+
+  xSemaphoreTake(RecvLock, portMAX_DELAY);
+  vTaskSetTimeOutState(&timeout);
+
+  while (done < nbyte) {
+    if (mode == SER_READ_UNTIL) {
+      int c = RingBufGet(&RecvBuf);
+      if (c >= 0) {
+        data[done++] = c;
+        if (c == (uint8_t)delim)
+          break;
+        continue;
+      }
+    } else {
+      done += RingBufRead(&RecvBuf, data + done, nbyte - done);
+      /* Return what was available, or the first span for blocking read. */
+      if (mode == SER_READ_AVAIL || (mode == SER_READ_SOME && done > 0))
+        break;
+      if (done == nbyte)
+        break;
+    }
+    if (!RecvWait(&timeout, &ticks))
+      break;
+  }
+
+  xSemaphoreGive(RecvLock);
+  return done;
+}
+
+size_t SerialRead(void *buf, size_t nbyte) {
+  return RecvGeneric(buf, nbyte, SER_READ_SOME, 0, portMAX_DELAY);
+}
+
+size_t SerialReadAvail(void *buf, size_t nbyte) {
+  return RecvGeneric(buf, nbyte, SER_READ_AVAIL, 0, 0);
+}
+
+size_t SerialReadExact(void *buf, size_t nbyte, TickType_t timeout) {
+  return RecvGeneric(buf, nbyte, SER_READ_EXACT, 0, timeout);
+}
+
+size_t SerialReadUntil(void *buf, size_t nbyte, char delim,
+                       TickType_t timeout) {
+  return RecvGeneric(buf, nbyte, SER_READ_UNTIL, delim, timeout);
+}
+
+void SerialGetStats(SerialStats_t *stats) {
+  taskENTER_CRITICAL();
+  *stats = Stats;
   taskEXIT_CRITICAL();
 }
 
 void SerialPutChar(char data) {
-  TriggerSend(data);
-  if (data == '\n') {
-    data = '\r';
-    TriggerSend(data);
-  }
+  SerialWrite(&data, 1);
 }
 
 int SerialGetChar(void) {
   char cRecv;
-  xQueueReceive(RecvQ, (void *)&cRecv, portMAX_DELAY);
+  (void)SerialRead(&cRecv, 1);
   return cRecv;
 }
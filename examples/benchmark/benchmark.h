@@ -0,0 +1,25 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <cia.h>
+
+/* Timer used by all benchmarks to count E_CLOCK ticks. */
+extern CIATimer_t *BenchTimer;
+
+/* One E_CLOCK tick takes 10 CPU cycles on 7.09MHz 68000. */
+#define TICKS2CYCLES(ticks) ((uint32_t)(ticks)*10)
+
+/* One PAL raster line takes 454 CPU cycles. Line counter is used to time
+ * what could take longer than 65536 E_CLOCK ticks. */
+#define LINES2CYCLES(lines) ((uint32_t)(lines)*454)
+
+void BenchMemory(void);
+void BenchBlitterMemory(void);
+void BenchPrintf(void);
+void BenchSerial(void);
+void BenchPipe(void);
+void BenchMfm(void);
+void BenchWrite(void);
+void BenchSeek(void);
+
+#endif /* !_BENCHMARK_H_ */
@@ -0,0 +1,60 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <custom.h>
+#include <interrupt.h>
+#include <stdio.h>
+
+#include "benchmark.h"
+
+#define mainBENCHMARK_TASK_PRIORITY 1
+
+CIATimer_t *BenchTimer;
+
+static void vBenchmarkTask(__unused void *data) {
+  BenchTimer = AcquireTimer(TIMER_ANY);
+  configASSERT(BenchTimer != NULL);
+
+  BenchMemory();
+  BenchBlitterMemory();
+  BenchPrintf();
+  BenchSerial();
+  BenchPipe();
+  BenchMfm();
+  BenchWrite();
+  BenchSeek();
+
+  ReleaseTimer(BenchTimer);
+  printf("[Benchmark] Finished!\n");
+
+  for (;;)
+    continue;
+}
+
+static void SystemClockTickHandler(__unused void *data) {
+  /* Increment the system timer value and possibly preempt. */
+  uint32_t ulSavedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+  xNeedRescheduleTask = xTaskIncrementTick();
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(ulSavedInterruptMask);
+}
+
+INTSERVER_DEFINE(SystemClockTick, 10, SystemClockTickHandler, NULL);
+
+static xTaskHandle handle;
+
+int main(void) {
+  portNOP(); /* Breakpoint for simulator. */
+
+  AddIntServer(VertBlankChain, SystemClockTick);
+
+  xTaskCreate(vBenchmarkTask, "bench", configMINIMAL_STACK_SIZE, NULL,
+              mainBENCHMARK_TASK_PRIORITY, &handle);
+
+  vTaskStartScheduler();
+
+  return 0;
+}
+
+void vApplicationIdleHook(void) {
+  custom.color[0] = 0x00f;
+}
@@ -0,0 +1,152 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <blitter.h>
+
+#include "benchmark.h"
+
+#define MAXSIZE 40960
+
+static const size_t Sizes[] = {16, 64, 256, 1024, 4096, 16384, MAXSIZE};
+
+/* The timer counts E-clock ticks in 16 bits, i.e. about 650k cycles. Copies
+ * between buffers of different evenness go byte by byte at about 22 cycles
+ * per byte, so larger ones would wrap the timer. */
+#define BYTECOPY_MAX 16384
+
+/* Offsets of destination and source buffers against longword boundary. */
+static const struct {
+  short dst, src;
+} Align[] = {{0, 0}, {2, 0}, {1, 1}, {1, 0}};
+
+typedef enum { MEMCPY, MEMSET, BZERO, BLTCOPY, BLTCLEAR } MemOp_t;
+
+static const char *MemOpName[] = {"memcpy", "memset", "bzero", "BltMemCopy",
+                                  "BltMemClear"};
+
+static uint16_t Measure(MemOp_t op, void *dst, void *src, size_t size) {
+  uint16_t ticks;
+
+  taskENTER_CRITICAL();
+  StartTimer(BenchTimer);
+  if (op == MEMCPY)
+    memcpy(dst, src, size);
+  else if (op == MEMSET)
+    memset(dst, 0xa5, size);
+  else if (op == BZERO)
+    bzero(dst, size);
+  else if (op == BLTCOPY)
+    BltMemCopy(dst, src, size);
+  else
+    BltMemClear(dst, size);
+  ticks = ReadTimer(BenchTimer);
+  taskEXIT_CRITICAL();
+
+  return ticks;
+}
+
+void BenchMemory(void) {
+  void *dstbuf = malloc(MAXSIZE + 4);
+  void *srcbuf = malloc(MAXSIZE + 4);
+  configASSERT(dstbuf != NULL && srcbuf != NULL);
+
+  printf("[Memory] dst=%p src=%p\n", dstbuf, srcbuf);
+
+  for (MemOp_t op = MEMCPY; op <= BZERO; op++) {
+    for (size_t i = 0; i < sizeof(Align) / sizeof(Align[0]); i++) {
+      /* Source alignment does not matter when there's no source. */
+      if (op != MEMCPY && Align[i].src)
+        continue;
+      for (size_t j = 0; j < sizeof(Sizes) / sizeof(Sizes[0]); j++) {
+        if (op == MEMCPY && (Align[i].dst ^ Align[i].src) & 1 &&
+            Sizes[j] > BYTECOPY_MAX)
+          continue;
+        void *dst = dstbuf + Align[i].dst;
+        void *src = srcbuf + Align[i].src;
+        size_t size = Sizes[j];
+        uint32_t cycles = TICKS2CYCLES(Measure(op, dst, src, size));
+        uint32_t cpb = cycles * 100 / size;
+        printf("[Memory] %s dst+%d src+%d %5d bytes: %7d cycles, "
+               "%d.%02d cycles/byte\n",
+               MemOpName[op], Align[i].dst, Align[i].src, (int)size,
+               (int)cycles, (int)(cpb / 100), (int)(cpb % 100));
+      }
+    }
+  }
+
+  free(srcbuf);
+  free(dstbuf);
+}
+
+/* Blitter works on chip memory while the CPU works on fast memory. */
+static uint16_t MeasureHybrid(MemOp_t op, BltMemJob_t *blt, BltMemJob_t *cpu,
+                              bool overlap) {
+  uint16_t ticks;
+
+  taskENTER_CRITICAL();
+  StartTimer(BenchTimer);
+  if (overlap) {
+    BltMemHybrid(blt, cpu);
+  } else if (op == BLTCOPY) {
+    BltMemCopy(blt->dst, blt->src, blt->size);
+    memcpy(cpu->dst, cpu->src, cpu->size);
+  } else {
+    BltMemClear(blt->dst, blt->size);
+    bzero(cpu->dst, cpu->size);
+  }
+  ticks = ReadTimer(BenchTimer);
+  taskEXIT_CRITICAL();
+
+  return ticks;
+}
+
+/* Compare CPU, blitter and hybrid paths for buffers in chip memory. */
+void BenchBlitterMemory(void) {
+  void *dst = pvPortMallocChip(MAXSIZE);
+  void *src = pvPortMallocChip(MAXSIZE);
+  void *fastdst = malloc(MAXSIZE);
+  void *fastsrc = malloc(MAXSIZE);
+  configASSERT(dst != NULL && src != NULL);
+  configASSERT(fastdst != NULL && fastsrc != NULL);
+
+  EnableDMA(DMAF_BLITTER);
+
+  for (MemOp_t op = MEMCPY; op <= BLTCLEAR; op++) {
+    if (op == MEMSET)
+      continue;
+    for (size_t j = 0; j < sizeof(Sizes) / sizeof(Sizes[0]); j++) {
+      size_t size = Sizes[j];
+      uint32_t cycles = TICKS2CYCLES(Measure(op, dst, src, size));
+      printf("[Chip] %s %5d bytes: %7d cycles\n", MemOpName[op], (int)size,
+             (int)cycles);
+    }
+  }
+
+  /* Same amount of work on fast memory buffers (if there is fast memory)
+   * done by the CPU after and during the blit. */
+  printf("[Hybrid] fast memory buffers: dst=%p src=%p\n", fastdst, fastsrc);
+
+  for (MemOp_t op = BLTCOPY; op <= BLTCLEAR; op++) {
+    for (size_t j = 0; j < sizeof(Sizes) / sizeof(Sizes[0]); j++) {
+      size_t size = Sizes[j];
+      bool copy = op == BLTCOPY;
+      BltMemJob_t blt = {.dst = dst, .src = copy ? src : NULL, .size = size};
+      BltMemJob_t cpu = {
+        .dst = fastdst, .src = copy ? fastsrc : NULL, .size = size};
+      uint32_t serial = TICKS2CYCLES(MeasureHybrid(op, &blt, &cpu, false));
+      uint32_t hybrid = TICKS2CYCLES(MeasureHybrid(op, &blt, &cpu, true));
+      printf("[Hybrid] %s %5d+%d bytes: %7d cycles serial, "
+             "%7d cycles hybrid\n",
+             MemOpName[op], (int)size, (int)size, (int)serial, (int)hybrid);
+    }
+  }
+
+  free(fastsrc);
+  free(fastdst);
+  free(src);
+  free(dst);
+}
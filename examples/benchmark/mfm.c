@@ -0,0 +1,178 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/queue.h>
+
+#include <floppy.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "benchmark.h"
+
+#define mainFLOPPY_TASK_PRIORITY 3
+#define mainFLUSH_TASK_PRIORITY 2
+
+/* Probably unused on the boot disk, but it's written back unchanged anyway. */
+#define WRITE_TRACK (TRACK_COUNT - 1)
+
+static void Report(const char *what, uint16_t ticks) {
+  printf("[MFM] %s: %d cycles\n", what, (int)TICKS2CYCLES(ticks));
+}
+
+static void ReportLines(const char *what, uint32_t lines) {
+  printf("[MFM] %s: %d cycles\n", what, (int)LINES2CYCLES(lines));
+}
+
+static void CpuDecode(DiskSector_t *sectors[], short n, uint32_t *buf) {
+  for (short i = 0; i < n; i++)
+    DecodeSector(sectors[i], buf + i * SECTOR_SIZE / sizeof(uint32_t));
+}
+
+static bool Same(const uint32_t *a, const uint32_t *b, size_t size) {
+  for (size_t i = 0; i < size / sizeof(uint32_t); i++)
+    if (a[i] != b[i])
+      return false;
+  return true;
+}
+
+/* Decode the first track of boot disk with the CPU and the blitter, then encode
+ * it back with both of them. */
+void BenchMfm(void) {
+  QueueHandle_t replyQ = xQueueCreate(1, sizeof(FloppyIO_t *));
+  FloppyIO_t io = {.cmd = CMD_READ, .track = 0, .replyQueue = replyQ};
+  FloppyIO_t *done;
+  DiskSector_t *sectors[SECTOR_COUNT_MAX];
+  DiskTrack_t *raw = AllocTrack();
+  uint32_t *fast = pvPortMalloc(TRACK_DATA_SIZE_MAX);
+  uint32_t *chip = pvPortMallocChip(TRACK_DATA_SIZE_MAX);
+  uint32_t found;
+  size_t size;
+  short n;
+  uint16_t ticks, busy;
+  uint32_t lines, busyLines;
+
+  io.buffer = AllocTrack();
+  configASSERT(io.buffer != NULL && raw != NULL);
+  configASSERT(fast != NULL && chip != NULL);
+
+  FloppyInit(mainFLOPPY_TASK_PRIORITY);
+  FloppySendIO(&io);
+  (void)xQueueReceive(replyQ, &done, portMAX_DELAY);
+  FloppyKill();
+
+  /* The driver tells whether it's a DD or HD disk. */
+  n = io.geometry->sectors;
+  size = n * SECTOR_SIZE;
+
+  StartTimer(BenchTimer);
+  found = DecodeTrack(io.buffer, io.geometry, 0, sectors);
+  Report("Locate sectors", ReadTimer(BenchTimer));
+  configASSERT(found == SECTOR_MASK(n));
+
+  StartTimer(BenchTimer);
+  CpuDecode(sectors, n, fast);
+  Report("CPU into fast memory", ReadTimer(BenchTimer));
+
+  /* Partial track read decodes and verifies only the requested sector. */
+  StartTimer(BenchTimer);
+  (void)DecodeSector(sectors[0], fast);
+  Report("CPU one sector into fast memory", ReadTimer(BenchTimer));
+
+  StartTimer(BenchTimer);
+  CpuDecode(sectors, n, chip);
+  Report("CPU into chip memory", ReadTimer(BenchTimer));
+
+  memset(chip, 0, size);
+  FloppyBltInit();
+
+  /* Time spent by the CPU in BltDecodeTrack is lost, the rest is free. */
+  StartTimer(BenchTimer);
+  BltDecodeTrack(sectors, n, chip);
+  busy = ReadTimer(BenchTimer);
+  BltDecodeWait();
+  ticks = ReadTimer(BenchTimer);
+  Report("Blitter", ticks);
+  Report("Blitter (CPU busy)", busy);
+
+  printf("[MFM] Blitter and CPU results %s\n",
+         Same(fast, chip, size) ? "match" : "differ!");
+
+  /* Encoding a whole track may take longer than the timer can count. */
+  LineCounterInit();
+
+  /* Raw track read from the disk is not needed anymore. */
+  lines = LineCounterRead();
+  EncodeTrack(io.buffer, io.geometry, 0, fast);
+  ReportLines("CPU encode", LineCounterRead() - lines);
+
+  lines = LineCounterRead();
+  BltEncodeTrack(raw, io.geometry, 0, chip);
+  busyLines = LineCounterRead() - lines;
+  BltEncodeWait();
+  lines = LineCounterRead() - lines;
+  ReportLines("Blitter encode", lines);
+  ReportLines("Blitter encode (CPU busy)", busyLines);
+
+  LineCounterKill();
+
+  printf("[MFM] Blitter and CPU encoded tracks %s\n",
+         Same((uint32_t *)io.buffer, (uint32_t *)raw, io.geometry->trackSize)
+           ? "match"
+           : "differ!");
+
+  FloppyBltKill();
+  vPortFree(chip);
+  vPortFree(fast);
+  vPortFree(raw);
+  vPortFree(io.buffer);
+  vQueueDelete(replyQ);
+}
+
+/* Write a track back unchanged through the track cache and check that
+ * the same data is read from the disk. Fails if the disk is write protected. */
+void BenchWrite(void) {
+  QueueHandle_t replyQ = xQueueCreate(1, sizeof(FloppyIO_t *));
+  FloppyIO_t io = {.unit = 0, .replyQueue = replyQ};
+  uint32_t *copy = pvPortMalloc(TRACK_DATA_SIZE_MAX);
+  uint32_t *check = pvPortMalloc(TRACK_DATA_SIZE_MAX);
+  TrackCacheStats_t stats;
+  const void *data;
+
+  io.buffer = AllocTrack();
+  configASSERT(io.buffer != NULL && copy != NULL && check != NULL);
+
+  FloppyInit(mainFLOPPY_TASK_PRIORITY);
+  TrackCacheInit(2, mainFLUSH_TASK_PRIORITY);
+
+  if ((data = TrackCacheGet(WRITE_TRACK))) {
+    short n = FloppyGetGeometry(0)->sectors;
+    size_t size = n * SECTOR_SIZE;
+    uint32_t lines, missing;
+    bool ok;
+
+    memcpy(copy, data, size);
+    TrackCacheRelease(data);
+
+    lines = LineCounterRead();
+    ok = TrackCacheWrite(WRITE_TRACK, SECTOR_MASK(n), copy) && TrackCacheSync();
+    lines = LineCounterRead() - lines;
+    TrackCacheGetStats(&stats);
+
+    /* Read the track from the disk rather than from the cache. */
+    missing = FloppyReadSectors(&io, WRITE_TRACK, SECTOR_MASK(n), check);
+
+    printf("[Write] track %d: %s in %d ms (%d flushed, %d failed), "
+           "read back %s\n",
+           WRITE_TRACK, ok ? "written" : "not written",
+           (int)(lines * 64 / 1000), (int)stats.flushes, (int)stats.failed,
+           !missing && Same(copy, check, size) ? "matches" : "differs!");
+  } else {
+    printf("[Write] Cannot read track %d!\n", WRITE_TRACK);
+  }
+
+  TrackCacheKill();
+  FloppyKill();
+
+  vPortFree(io.buffer);
+  vPortFree(check);
+  vPortFree(copy);
+  vQueueDelete(replyQ);
+}
@@ -0,0 +1,102 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+#include <FreeRTOS/queue.h>
+
+#include <pipe.h>
+#include <stdio.h>
+
+#include "benchmark.h"
+
+#define NBYTES 16384
+#define BUFSIZE 1024
+#define CHUNK 256
+
+#define mainPRODUCER_TASK_PRIORITY 1
+
+typedef enum { QUEUE, PIPE, RESERVE } Method_t;
+
+static const char *MethodName[] = {"queue of chars", "pipe",
+                                   "pipe with reservation"};
+
+static QueueHandle_t CharQueue;
+static File_t *PipeWriter;
+
+static void vProducerTask(void *data) {
+  Method_t method = (Method_t)data;
+
+  if (method == QUEUE) {
+    for (int i = 0; i < NBYTES; i++) {
+      char c = i;
+      (void)xQueueSend(CharQueue, &c, portMAX_DELAY);
+    }
+  } else if (method == PIPE) {
+    static char chunk[CHUNK];
+    for (int i = 0; i < CHUNK; i++)
+      chunk[i] = i;
+    for (int i = 0; i < NBYTES / CHUNK; i++)
+      FileWrite(PipeWriter, chunk, CHUNK);
+    FileClose(PipeWriter);
+  } else {
+    /* Data is produced in place, spans get shorter where buffer wraps. */
+    for (int i = 0; i < NBYTES;) {
+      char *span;
+      long n = PipeReserve(PipeWriter, (void **)&span,
+                           min(CHUNK, NBYTES - i));
+      if (n < 0)
+        break;
+      for (int j = 0; j < n; j++)
+        span[j] = i + j;
+      PipeCommit(PipeWriter, n);
+      i += n;
+    }
+    FileClose(PipeWriter);
+  }
+
+  vTaskDelete(NULL);
+}
+
+/* Consume data produced by the other task and measure the throughput. */
+static void BenchStream(Method_t method) {
+  static char chunk[CHUNK];
+  File_t *reader = NULL;
+  size_t total = 0;
+  uint32_t frames;
+
+  if (method == QUEUE) {
+    CharQueue = xQueueCreate(BUFSIZE, sizeof(char));
+    configASSERT(CharQueue != NULL);
+  } else {
+    bool ok = PipeOpen(BUFSIZE, &reader, &PipeWriter);
+    configASSERT(ok);
+  }
+
+  frames = ReadFrameCounter();
+
+  xTaskCreate(vProducerTask, "producer", configMINIMAL_STACK_SIZE,
+              (void *)method, mainPRODUCER_TASK_PRIORITY, NULL);
+
+  if (method == QUEUE) {
+    for (; total < NBYTES; total++)
+      (void)xQueueReceive(CharQueue, chunk, portMAX_DELAY);
+  } else {
+    long n;
+    while ((n = FileRead(reader, chunk, CHUNK)) > 0)
+      total += n;
+  }
+
+  frames = ReadFrameCounter() - frames;
+
+  if (method == QUEUE)
+    vQueueDelete(CharQueue);
+  else
+    FileClose(reader);
+
+  /* PAL frame counter advances 50 times per second. */
+  printf("[Pipe] %s: %d bytes in %d frames, %d bytes/s\n", MethodName[method],
+         (int)total, (int)frames, (int)(frames ? total * 50 / frames : 0));
+}
+
+void BenchPipe(void) {
+  for (Method_t method = QUEUE; method <= RESERVE; method++)
+    BenchStream(method);
+}
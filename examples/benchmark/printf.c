@@ -0,0 +1,96 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <serial.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "benchmark.h"
+
+#define LINES 100
+#define BAUD 115200
+
+static char Buffer[128];
+static size_t Length;
+
+static void MemPutChar(char c) {
+  Buffer[Length++] = c;
+}
+
+static void MemPutStr(const char *s, size_t n) {
+  memcpy(Buffer + Length, s, n);
+  Length += n;
+}
+
+/* Typical line of a log dumped by drivers. */
+#define LOGLINE(i)                                                             \
+  "[Log] %5d: addr=%08x val=%d count=%u flags=%x %s\n", (i), 0xc00000 + (i),   \
+    -(i)*12345, (i)*98765, (i)*7, "done"
+
+typedef enum { PUTCHAR, PUTSTR, SNPRINTF } MemSink_t;
+
+static const char *MemSinkName[] = {"kvprintf", "kvprintf_bulk", "snprintf"};
+
+static void MemPrintf(MemSink_t sink, const char *fmt, ...) {
+  va_list ap;
+
+  va_start(ap, fmt);
+  Length = 0;
+  if (sink == PUTCHAR)
+    kvprintf(MemPutChar, fmt, ap);
+  else if (sink == PUTSTR)
+    kvprintf_bulk(MemPutStr, fmt, ap);
+  else
+    Length = vsnprintf(Buffer, sizeof(Buffer), fmt, ap);
+  va_end(ap);
+}
+
+static void BenchMemPrintf(MemSink_t sink) {
+  uint32_t cycles = 0, bytes = 0;
+
+  for (int i = 0; i < LINES; i++) {
+    taskENTER_CRITICAL();
+    StartTimer(BenchTimer);
+    MemPrintf(sink, LOGLINE(i));
+    cycles += TICKS2CYCLES(ReadTimer(BenchTimer));
+    taskEXIT_CRITICAL();
+    bytes += Length;
+  }
+
+  printf("[Printf] memory %s: %d bytes in %d cycles, %d cycles/byte\n",
+         MemSinkName[sink], (int)bytes, (int)cycles,
+         (int)(cycles / bytes));
+}
+
+static const char *BufModeName[] = {"unbuffered", "line buffered",
+                                     "fully buffered"};
+
+static void BenchSerialPrintf(File_t *ser, short mode) {
+  static char wbuf[256];
+
+  FileSetBuf(ser, mode, wbuf, sizeof(wbuf));
+
+  uint32_t frames = ReadFrameCounter();
+
+  for (int i = 0; i < LINES; i++)
+    FilePrintf(ser, LOGLINE(i));
+  FileFlush(ser);
+
+  frames = ReadFrameCounter() - frames;
+  printf("[Printf] serial (%d baud, %s): %d lines in %d frames\n", BAUD,
+         BufModeName[mode], LINES, (int)frames);
+
+  FileSetBuf(ser, FBUF_NONE, NULL, 0);
+}
+
+void BenchPrintf(void) {
+  BenchMemPrintf(PUTCHAR);
+  BenchMemPrintf(PUTSTR);
+  BenchMemPrintf(SNPRINTF);
+
+  File_t *ser = SerialOpen(BAUD);
+  BenchSerialPrintf(ser, FBUF_NONE);
+  BenchSerialPrintf(ser, FBUF_LINE);
+  BenchSerialPrintf(ser, FBUF_FULL);
+  FileClose(ser);
+}
@@ -0,0 +1,67 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/queue.h>
+
+#include <floppy.h>
+#include <stdio.h>
+
+#include "benchmark.h"
+
+#define mainFLOPPY_TASK_PRIORITY 3
+
+#define NREADS 20
+
+/* Sequential reads visit both sides of each cylinder, the other pattern jumps
+ * back and forth across the disk and reverses stepping direction each time. */
+static uint16_t Track(short pattern, short i) {
+  if (pattern == 0)
+    return i;
+  return (i & 1) ? 80 + i : i;
+}
+
+static const char *PatternName[] = {"sequential", "back and forth"};
+
+/* Sum up head positioning time of requests issued one by one. */
+static void BenchPattern(FloppyIO_t *io, short pattern) {
+  FloppyIO_t *done;
+  uint32_t total = 0;
+
+  for (short i = 0; i < NREADS; i++) {
+    io->track = Track(pattern, i);
+    FloppySendIO(io);
+    (void)xQueueReceive(io->replyQueue, &done, portMAX_DELAY);
+    total += io->seekTime;
+  }
+
+  printf("[Seek] %s: %d us per track\n", PatternName[pattern],
+         (int)(total / NREADS));
+}
+
+void BenchSeek(void) {
+  static const FloppyPolicy_t noPrefetch = {
+    .prefetch = 0, .motorMin = 500, .motorMax = 4000};
+  FloppyIO_t io = {.cmd = CMD_READ};
+
+  io.buffer = AllocTrack();
+  io.replyQueue = xQueueCreate(1, sizeof(FloppyIO_t *));
+  configASSERT(io.buffer != NULL && io.replyQueue != NULL);
+
+  FloppyInit(mainFLOPPY_TASK_PRIORITY);
+  FloppySetPolicy(&noPrefetch);
+
+  printf("[Seek] Standard profile\n");
+  for (short pattern = 0; pattern < 2; pattern++)
+    BenchPattern(&io, pattern);
+
+  FloppySetSeekProfile(0, &FloppySeekFast);
+  printf("[Seek] Fast profile\n");
+  for (short pattern = 0; pattern < 2; pattern++)
+    BenchPattern(&io, pattern);
+
+  /* Phases of all requests issued above, see tools/floppyhist.py. */
+  FloppyDumpHistograms(KernCons, 0);
+
+  FloppyKill();
+
+  vPortFree(io.buffer);
+  vQueueDelete(io.replyQueue);
+}
@@ -0,0 +1,39 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <serial.h>
+#include <stdio.h>
+
+#include "benchmark.h"
+
+#define NBYTES 4096
+
+static const unsigned Bauds[] = {9600, 38400, 115200};
+
+/* Measure sustained transmit throughput. Data does not contain newlines,
+ * so that each byte put into the buffer is sent exactly once. */
+static void BenchSerialWrite(unsigned baud) {
+  static char data[256];
+
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = ' ' + (i % 64);
+
+  File_t *ser = SerialOpen(baud);
+
+  uint32_t frames = ReadFrameCounter();
+  for (int i = 0; i < NBYTES / (int)sizeof(data); i++)
+    SerialWrite(data, sizeof(data));
+  frames = ReadFrameCounter() - frames;
+
+  /* Waits for the transmitter to drain. */
+  FileClose(ser);
+
+  /* PAL frame counter advances 50 times per second. */
+  printf("[Serial] %6d baud: %d bytes in %d frames, %d bytes/s\n", baud,
+         NBYTES, (int)frames, (int)(frames ? NBYTES * 50 / frames : 0));
+}
+
+void BenchSerial(void) {
+  for (size_t i = 0; i < sizeof(Bauds) / sizeof(Bauds[0]); i++)
+    BenchSerialWrite(Bauds[i]);
+}
@@ -3,41 +3,60 @@
 #include <FreeRTOS/queue.h>
 
 #include <floppy.h>
+#include <string.h>
 
 #include "filesys.h"
 
+/*
+ * Read-only filesystem in the format created by tools/fsutil.py. Directory is
+ * read into memory at mount time. Files are contiguous, so file offset maps
+ * directly onto disk offset. Directory operations and asynchronous reads are
+ * served by the filesystem task. Synchronous reads and maps are done by the
+ * calling task itself. All data comes from the track cache, while the floppy
+ * driver reads the track that follows the last one ahead.
+ */
+
 typedef enum {
   FS_MOUNT,   /* mount filesystem */
   FS_UNMOUNT, /* unmount filesystem */
   FS_DIRENT,  /* fetch one directory entry */
   FS_OPEN,    /* open a file */
   FS_CLOSE,   /* close the file */
-  FS_READ     /* read some bytes from the file */
+  FS_READ     /* asynchronous read, replied to request's queue */
 } FsCmd_t;
 
-/* The type of message send to file system task. */
+/* The type of message send to file system task. The reply is the same
+ * message with results filled in, except for FS_READ. */
 typedef struct FsMsg {
   FsCmd_t cmd;      /* request type */
   QueueHandle_t rq; /* where to return a reply */
   union {           /* data specific to given request type */
     struct {
+      bool ok;
     } mount;
     struct {
+      int nopen; /* number of files still opened */
     } umount;
     struct {
+      const DirEntry_t *de; /* previous entry or NULL, replaced by next one */
     } dirent;
     struct {
+      const char *name;
+      const DirEntry_t *de; /* NULL if file was not found */
     } open;
     struct {
+      const DirEntry_t *de;
     } close;
     struct {
+      FileReq_t *req;
     } read;
   };
 } FsMsg_t;
 
 typedef struct FsFile {
   File_t f;
-  DirEntry_t *de;
+  const DirEntry_t *de;
+  const void *mapped; /* track lent by FsMap */
 } FsFile_t;
 
 static QueueHandle_t GetFsReplyQueue(void);
@@ -45,107 +64,372 @@ static QueueHandle_t GetFsReplyQueue(void);
 static long FsRead(FsFile_t *f, void *buf, size_t nbyte);
 static long FsSeek(FsFile_t *f, long offset, int whence);
 static void FsClose(FsFile_t *f);
+static long FsMap(FsFile_t *f, const void **bufp, size_t nbyte);
+static void FsUnmap(FsFile_t *f, const void *buf, size_t nbyte);
+static bool FsReadAsync(FsFile_t *f, FileReq_t *req);
+
+static FileOps_t FsOps = {.read = (FileRead_t)FsRead,
+                          .seek = (FileSeek_t)FsSeek,
+                          .close = (FileClose_t)FsClose,
+                          .map = (FileMap_t)FsMap,
+                          .unmap = (FileUnmap_t)FsUnmap,
+                          .readasync = (FileReadAsync_t)FsReadAsync};
+
+#define FS_MAXMSG 8
+
+static QueueHandle_t FsQueue;
+
+/* Number of tracks kept in the track cache. */
+#define FS_NTRACKS 4
 
-__unused static FileOps_t FsOps = {.read = (FileRead_t)FsRead,
-                                   .seek = (FileSeek_t)FsSeek,
-                                   .close = (FileClose_t)FsClose};
+/* Known once the first track has been read. */
+static uint32_t TrackSize = SECTOR_COUNT * SECTOR_SIZE;
 
-static void SendIO(FloppyIO_t *io, short track) {
-  io->track = track;
-  FloppySendIO(io);
+/* Tracks beyond the end of the disk cannot be read. */
+static const void *GetTrack(uint32_t num) {
+  return num < TRACK_COUNT ? TrackCacheGet(num) : NULL;
 }
 
-static void WaitIO(QueueHandle_t replyQ, void *buf) {
-  FloppyIO_t *io = NULL;
-  (void)xQueueReceive(replyQ, &io, portMAX_DELAY);
+/* Read `nbyte` bytes at disk offset `pos`. Returns -1 on error. */
+static long ReadDisk(uint32_t pos, void *buf, size_t nbyte) {
+  char *data = buf;
+  size_t done = 0;
 
-  DiskSector_t *sectors[SECTOR_COUNT];
-  DecodeTrack(io->buffer, sectors);
-  for (int j = 0; j < SECTOR_COUNT; j++)
-    DecodeSector(sectors[j], buf + j * SECTOR_SIZE);
+  while (done < nbyte) {
+    uint32_t num = pos / TrackSize;
+    uint32_t skip = pos - num * TrackSize;
+    size_t n = min(nbyte - done, (size_t)(TrackSize - skip));
+    const void *track;
+
+    if (!(track = GetTrack(num)))
+      return -1;
+
+    memcpy(data + done, track + skip, n);
+    TrackCacheRelease(track);
+    done += n;
+    pos += n;
+  }
+
+  return done;
 }
 
-static void vFileSysTask(__unused void *data) {
-  QueueHandle_t replyQ = xQueueCreate(2, sizeof(FloppyIO_t *));
-  void *buf = pvPortMalloc(SECTOR_SIZE * SECTOR_COUNT);
-
-  /*
-   * For double buffering we need (sic!) two track buffers:
-   *  - one track will be owned by floppy driver
-   *    which will set up a DMA transfer to it
-   *  - the track will be decoded from MFM format
-   *    and possibly read by this task
-   */
-  FloppyIO_t io[2];
-  for (short i = 0; i < 2; i++) {
-    io[i].cmd = CMD_READ;
-    io[i].buffer = AllocTrack();
-    io[i].replyQueue = replyQ;
+/* Directory as read from the disk, NULL if not mounted. */
+static DirEntry_t *Dir;
+static size_t DirSize;
+static short NOpen;
+static uint32_t DiskChanges;
+
+#define DIR_OFFSET (2 * SECTOR_SIZE)
+
+static const DirEntry_t *NextDirEntry(const DirEntry_t *de);
+
+/* File must lie within the disk, or reading it would go past the last track. */
+static bool FileFits(const DirEntry_t *de) {
+  uint32_t disk = TrackSize * TRACK_COUNT;
+  uint32_t start = de->start * SECTOR_SIZE;
+  return start <= disk && de->size <= disk - start;
+}
+
+/*
+ * Directory index built at mount time: hash table with linear probing, which
+ * is kept at most half full, so FsOpen compares names of few entries only.
+ * Names are not copied, as each one is stored once in the directory buffer.
+ */
+
+typedef struct DirSlot {
+  uint32_t hash;
+  const DirEntry_t *de; /* NULL if the slot is empty */
+} DirSlot_t;
+
+static DirSlot_t *DirIndex;
+static uint16_t DirMask; /* number of slots minus one */
+
+/* Uses only shifts and additions, which are cheap on 68000. */
+static uint32_t NameHash(const char *name) {
+  uint32_t hash = 5381;
+
+  while (*name)
+    hash = (hash << 5) + hash + (uint8_t)*name++;
+
+  return hash;
+}
+
+static DirSlot_t *LookupSlot(const char *name, uint32_t hash) {
+  DirSlot_t *slot;
+
+  for (uint16_t i = hash;; i++) {
+    slot = &DirIndex[i & DirMask];
+    if (!slot->de || (slot->hash == hash && !strcmp(slot->de->name, name)))
+      return slot;
+  }
+}
+
+static bool BuildIndex(void) {
+  const DirEntry_t *de = NULL;
+  uint16_t n = 0, size = 2;
+
+  while ((de = NextDirEntry(de)))
+    n++;
+  while (size < 2 * n)
+    size <<= 1;
+
+  if (!(DirIndex = pvPortMalloc(size * sizeof(DirSlot_t))))
+    return false;
+
+  memset(DirIndex, 0, size * sizeof(DirSlot_t));
+  DirMask = size - 1;
+
+  /* Duplicate names resolve to the first entry, like in the directory. */
+  while ((de = NextDirEntry(de))) {
+    uint32_t hash = NameHash(de->name);
+    DirSlot_t *slot = LookupSlot(de->name, hash);
+    if (!slot->de) {
+      slot->hash = hash;
+      slot->de = de;
+    }
   }
 
+  return true;
+}
+
+static bool DoMount(void) {
+  const void *track;
+  uint16_t size;
+
+  if (Dir)
+    return false;
+
+  DiskChanges = FloppyDiskChanges(0);
+
+  /* Geometry is known after the first track has been read. */
+  if (!(track = GetTrack(0)))
+    return false;
+
+  TrackSize = FloppyGetGeometry(0)->sectors * SECTOR_SIZE;
+  memcpy(&size, track + DIR_OFFSET, sizeof(size));
+  TrackCacheRelease(track);
+
+  if (!(Dir = pvPortMalloc(size)))
+    return false;
+
+  DirSize = size;
+
+  if (ReadDisk(DIR_OFFSET + sizeof(size), Dir, size) < 0 || !BuildIndex()) {
+    vPortFree(Dir);
+    Dir = NULL;
+    return false;
+  }
+
+  NOpen = 0;
+  return true;
+}
+
+static int DoUnMount(void) {
+  if (NOpen > 0)
+    return NOpen;
+
+  if (Dir) {
+    vPortFree(DirIndex);
+    vPortFree(Dir);
+    Dir = NULL;
+  }
+  return 0;
+}
+
+/* Entries of files that do not fit on the disk are skipped, so they can be
+ * neither listed nor opened. */
+static const DirEntry_t *NextDirEntry(const DirEntry_t *de) {
+  void *end = (void *)Dir + DirSize;
+
+  if (!Dir)
+    return NULL;
+
+  for (de = de ? (void *)de + de->reclen : Dir;; de = (void *)de + de->reclen) {
+    if ((void *)de >= end || de->reclen == 0 || (void *)de + de->reclen > end)
+      return NULL;
+    if (FileFits(de))
+      return de;
+  }
+}
+
+static const DirEntry_t *DoOpen(const char *name) {
+  const DirEntry_t *de;
+
+  if (!Dir)
+    return NULL;
+
+  if ((de = LookupSlot(name, NameHash(name))->de))
+    NOpen++;
+  return de;
+}
+
+/* Read at current file position and advance it. Data of a disk that was
+ * replaced is not returned. */
+static long DoRead(FsFile_t *ff, void *buf, size_t nbyte) {
+  const DirEntry_t *de = ff->de;
+  uint32_t offset = ff->f.offset;
+  long n;
+
+  if (FloppyDiskChanges(0) != DiskChanges)
+    return -1;
+
+  if (offset >= de->size)
+    return 0;
+
+  nbyte = min(nbyte, (size_t)(de->size - offset));
+  if ((n = ReadDisk(de->start * SECTOR_SIZE + offset, buf, nbyte)) > 0)
+    ff->f.offset += n;
+  return n;
+}
+
+static void vFileSysTask(__unused void *data) {
   for (;;) {
-    short track = 0;
-    short active = 0;
-
-    /* Initiate double buffered reads. */
-    SendIO(&io[active], track++);
-    active ^= 1;
-
-    do {
-      /* Request asynchronous read into second buffer. */
-      SendIO(&io[active], track++);
-      active ^= 1;
-      /* Wait for reply with first buffer and decode it. */
-      WaitIO(replyQ, buf);
-    } while (track < TRACK_COUNT);
-
-    /* Finish last track. */
-    WaitIO(replyQ, buf);
-
-    /* Wait two seconds and repeat. */
-    vTaskDelay(2000 / portTICK_PERIOD_MS);
+    FsMsg_t msg;
+
+    (void)xQueueReceive(FsQueue, &msg, portMAX_DELAY);
+
+    switch (msg.cmd) {
+      case FS_MOUNT:
+        msg.mount.ok = DoMount();
+        break;
+      case FS_UNMOUNT:
+        msg.umount.nopen = DoUnMount();
+        break;
+      case FS_DIRENT:
+        msg.dirent.de = NextDirEntry(msg.dirent.de);
+        break;
+      case FS_OPEN:
+        msg.open.de = DoOpen(msg.open.name);
+        break;
+      case FS_CLOSE:
+        NOpen--;
+        break;
+      case FS_READ: {
+        FileReq_t *req = msg.read.req;
+        req->result = DoRead((FsFile_t *)req->file, req->buf, req->nbyte);
+        (void)xQueueSend(req->replyQueue, &req, portMAX_DELAY);
+        continue;
+      }
+    }
+
+    (void)xQueueSend(msg.rq, &msg, portMAX_DELAY);
   }
 }
 
-bool FsMount(void) {
+/* Send request to filesystem task and wait for the reply. */
+static void FsCall(FsMsg_t *msg) {
   QueueHandle_t rq = GetFsReplyQueue();
   configASSERT(rq != NULL);
 
-  return false;
+  msg->rq = rq;
+  (void)xQueueSend(FsQueue, msg, portMAX_DELAY);
+  (void)xQueueReceive(rq, msg, portMAX_DELAY);
+}
+
+bool FsMount(void) {
+  FsMsg_t msg = {.cmd = FS_MOUNT};
+  FsCall(&msg);
+  return msg.mount.ok;
 }
 
 /* Remember to free memory used up by a directory! */
 int FsUnMount(void) {
-  return 0;
+  FsMsg_t msg = {.cmd = FS_UNMOUNT};
+  FsCall(&msg);
+  return msg.umount.nopen;
 }
 
 const DirEntry_t *FsListDir(void **base_p) {
-  (void)base_p;
-  return NULL;
+  FsMsg_t msg = {.cmd = FS_DIRENT, .dirent = {.de = *base_p}};
+  FsCall(&msg);
+  *base_p = (void *)msg.dirent.de;
+  return msg.dirent.de;
 }
 
 File_t *FsOpen(const char *name) {
-  (void)name;
-  return NULL;
+  FsMsg_t msg = {.cmd = FS_OPEN, .open = {.name = name}};
+  FsFile_t *ff;
+
+  if (!(ff = pvPortMalloc(sizeof(FsFile_t))))
+    return NULL;
+
+  FsCall(&msg);
+
+  if (!msg.open.de) {
+    vPortFree(ff);
+    return NULL;
+  }
+
+  memset(ff, 0, sizeof(FsFile_t));
+  ff->f.ops = &FsOps;
+  ff->f.usecount = 1;
+  ff->de = msg.open.de;
+  return &ff->f;
 }
 
 static void FsClose(FsFile_t *ff) {
-  (void)ff;
+  FsMsg_t msg = {.cmd = FS_CLOSE, .close = {.de = ff->de}};
+  FsCall(&msg);
+  vPortFree(ff);
 }
 
+/* Track cache can be used by many tasks at once. */
 static long FsRead(FsFile_t *ff, void *buf, size_t nbyte) {
-  (void)ff;
-  (void)buf;
-  (void)nbyte;
-  return -1;
+  return DoRead(ff, buf, nbyte);
+}
+
+/* Lend the part of cached track up to its end. */
+static long FsMap(FsFile_t *ff, const void **bufp, size_t nbyte) {
+  const DirEntry_t *de = ff->de;
+  uint32_t offset = ff->f.offset;
+  uint32_t pos = de->start * SECTOR_SIZE + offset;
+  uint32_t skip = pos % TrackSize;
+  const void *track;
+  size_t n;
+
+  if (FloppyDiskChanges(0) != DiskChanges)
+    return -1;
+
+  if (offset >= de->size)
+    return 0;
+
+  if (!(track = GetTrack(pos / TrackSize)))
+    return -1;
+
+  n = min(nbyte, (size_t)min(de->size - offset, TrackSize - skip));
+  ff->mapped = track;
+  ff->f.offset += n;
+  *bufp = track + skip;
+  return n;
+}
+
+static void FsUnmap(FsFile_t *ff, __unused const void *buf,
+                    __unused size_t nbyte) {
+  if (ff->mapped)
+    TrackCacheRelease(ff->mapped);
+  ff->mapped = NULL;
+}
+
+/* The filesystem task reads the data, while the caller does something else. */
+static bool FsReadAsync(__unused FsFile_t *ff, FileReq_t *req) {
+  FsMsg_t msg = {.cmd = FS_READ, .read = {.req = req}};
+  return xQueueSend(FsQueue, &msg, portMAX_DELAY);
 }
 
 /* Does not involve direct interaction with the filesystem. */
 static long FsSeek(FsFile_t *ff, long offset, int whence) {
-  (void)ff;
-  (void)offset;
-  (void)whence;
-  return -1;
+  if (whence == SEEK_CUR)
+    offset += ff->f.offset;
+  else if (whence == SEEK_END)
+    offset += ff->de->size;
+  else if (whence != SEEK_SET)
+    return -1;
+
+  if (offset < 0)
+    return -1;
+
+  ff->f.offset = offset;
+  return offset;
 }
 
 static xTaskHandle filesys_handle;
@@ -155,6 +439,10 @@ static xTaskHandle filesys_handle;
 
 void FsInit(void) {
   FloppyInit(FLOPPY_TASK_PRIO);
+  /* Nothing is written, so the flusher task never runs. */
+  TrackCacheInit(FS_NTRACKS, FILESYS_TASK_PRIO);
+  FsQueue = xQueueCreate(FS_MAXMSG, sizeof(FsMsg_t));
+  configASSERT(FsQueue != NULL);
   xTaskCreate(vFileSysTask, "filesys", configMINIMAL_STACK_SIZE, NULL,
               FILESYS_TASK_PRIO, &filesys_handle);
 }
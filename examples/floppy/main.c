@@ -1,31 +1,114 @@
 #include <FreeRTOS/FreeRTOS.h>
 #include <FreeRTOS/task.h>
 
+#include <cia.h>
 #include <interrupt.h>
+#include <readahead.h>
 #include <stdio.h>
 #include <serial.h>
 
 #include "filesys.h"
 
 #define FOREGROUND_TASK_PRIO 0
-#define BACKGROUND_TASK_PRIO 0
 
-static void vForegroundTask(File_t *ser) {
-  CreateFsReplyQueue();
+/* Line counter advances every 64us. */
+#define LINES2US(lines) ((lines)*64)
 
-  for (;;)
-    FilePutChar(ser, '-');
+/* Open each file and read it sequentially in chunks of this size. */
+#define CHUNK 4096
 
-  DeleteFsReplyQueue();
+typedef enum { READ, MAP } Method_t;
+
+static const char *MethodName[] = {"read-ahead", "mapped"};
+
+/* Sum of data, so both methods can be checked to return the same bytes. */
+static uint32_t Checksum(uint32_t sum, const uint8_t *data, long n) {
+  while (n-- > 0)
+    sum = (sum << 1 | sum >> 31) + *data++;
+  return sum;
+}
+
+/* Read-ahead keeps up to two tracks, the next one is read by the filesystem
+ * task while the current one is consumed. Mapped reads copy no data at all,
+ * as it is lent straight from the track cache. */
+static uint32_t ReadFile(File_t *ser, const char *name, Method_t method) {
+  static uint8_t buf[CHUNK];
+  size_t track = FloppyGetGeometry(0)->sectors * SECTOR_SIZE;
+  uint32_t start, opened, elapsed, total = 0, sum = 0;
+  uint32_t ms;
+  File_t *f;
+  long n;
+
+  start = LineCounterRead();
+  f = FsOpen(name);
+  if (f && method == READ) {
+    ReadAheadParams_t params = {.align = track,
+                                .minwin = track,
+                                .maxwin = 2 * track,
+                                .trigger = 1,
+                                .async = true};
+    File_t *ra = ReadAheadOpen(f, &params);
+    if (!ra)
+      FileClose(f);
+    f = ra;
+  }
+  opened = LineCounterRead() - start;
+
+  if (!f) {
+    FilePrintf(ser, "%s: failed to open!\n", name);
+    return 0;
+  }
+
+  if (method == READ) {
+    while ((n = FileRead(f, buf, CHUNK)) > 0) {
+      sum = Checksum(sum, buf, n);
+      total += n;
+    }
+  } else {
+    const void *data;
+    while ((n = FileMap(f, &data, CHUNK)) > 0) {
+      sum = Checksum(sum, data, n);
+      FileUnmap(f, data, n);
+      total += n;
+    }
+  }
+  elapsed = LineCounterRead() - start - opened;
+  FileClose(f);
+
+  ms = LINES2US(elapsed) / 1000;
+  FilePrintf(ser,
+             "%s (%s): opened in %d us, read %d bytes in %d ms (%d bytes/s)",
+             name, MethodName[method], (int)LINES2US(opened), (int)total,
+             (int)ms, (int)(ms ? total * 1000 / ms : 0));
+  FilePrintf(ser, n < 0 ? ", read error!\n" : "\n");
+  return sum;
 }
 
-static void vBackgroundTask(File_t *ser) {
+static void vForegroundTask(File_t *ser) {
+  const DirEntry_t *de;
+  void *base = NULL;
+  uint32_t start;
+
   CreateFsReplyQueue();
 
-  for (;;)
-    FilePutChar(ser, '+');
+  start = LineCounterRead();
+  if (FsMount()) {
+    FilePrintf(ser, "Filesystem mounted in %d ms\n",
+               (int)(LINES2US(LineCounterRead() - start) / 1000));
+
+    while ((de = FsListDir(&base))) {
+      uint32_t sum = ReadFile(ser, de->name, READ);
+      if (ReadFile(ser, de->name, MAP) != sum)
+        FilePrintf(ser, "%s: mapped data differs!\n", de->name);
+    }
+
+    (void)FsUnMount();
+  } else {
+    FilePrintf(ser, "Failed to mount filesystem!\n");
+  }
 
   DeleteFsReplyQueue();
+  vTaskDelete(NULL);
 }
 
 static void SystemClockTickHandler(__unused void *data) {
@@ -38,7 +121,6 @@ static void SystemClockTickHandler(__unused void *data) {
 INTSERVER_DEFINE(SystemClockTick, 10, SystemClockTickHandler, NULL);
 
 static xTaskHandle fg_handle;
-static xTaskHandle bg_handle;
 
 int main(void) {
   portNOP(); /* Breakpoint for simulator. */
@@ -50,9 +132,6 @@ int main(void) {
   xTaskCreate((TaskFunction_t)vForegroundTask, "foreground",
               configMINIMAL_STACK_SIZE, ser, FOREGROUND_TASK_PRIO, &fg_handle);
 
-  xTaskCreate((TaskFunction_t)vBackgroundTask, "background",
-              configMINIMAL_STACK_SIZE, ser, BACKGROUND_TASK_PRIO, &bg_handle);
-
   FsInit();
 
   vTaskStartScheduler();
@@ -11,18 +11,20 @@ typedef struct MemFile {
 static long MemoryRead(MemFile_t *f, void *buf, size_t nbyte);
 static long MemorySeek(MemFile_t *f, long offset, int whence);
 static void MemoryClose(MemFile_t *f);
+static long MemoryMap(MemFile_t *f, const void **bufp, size_t nbyte);
 
 static FileOps_t MemOps = {.read = (FileRead_t)MemoryRead,
                            .seek = (FileSeek_t)MemorySeek,
-                           .close = (FileClose_t)MemoryClose};
+                           .close = (FileClose_t)MemoryClose,
+                           .map = (FileMap_t)MemoryMap};
 
 File_t *MemoryOpen(const void *buf, size_t length) {
   MemFile_t *mem = pvPortMalloc(sizeof(MemFile_t));
+  memset(mem, 0, sizeof(MemFile_t));
   mem->buf = buf;
   mem->length = length;
   mem->f.ops = &MemOps;
   mem->f.usecount = 1;
-  mem->f.offset = 0;
   return &mem->f;
 }
 
@@ -43,6 +45,19 @@ static long MemoryRead(MemFile_t *mem, void *buf, size_t nbyte) {
   return nread;
 }
 
+/* Memory file lends its own buffer, so there's nothing to release. */
+static long MemoryMap(MemFile_t *mem, const void **bufp, size_t nbyte) {
+  long start = mem->f.offset;
+  long nread = nbyte;
+
+  if (start + nread > mem->length)
+    nread = mem->length - start;
+
+  *bufp = mem->buf + start;
+  mem->f.offset += nread;
+  return nread;
+}
+
 static long MemorySeek(MemFile_t *mem, long offset, int whence) {
   if (whence == SEEK_CUR) {
     offset += mem->f.offset;
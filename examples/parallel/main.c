@@ -0,0 +1,107 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <cia.h>
+#include <custom.h>
+#include <interrupt.h>
+#include <parallel.h>
+#include <stdio.h>
+
+#define mainMAIN_TASK_PRIORITY 1
+
+#define NBYTES 32768
+#define CHUNK 1024
+
+static uint8_t Chunk[CHUNK];
+
+static void Report(const char *what, size_t nbyte, uint32_t frames) {
+  /* PAL frame counter advances 50 times per second. */
+  printf("\n[%s] %d bytes in %d frames, %d bytes/s\n", what, (int)nbyte,
+         (int)frames, (int)(frames ? nbyte * 50 / frames : 0));
+}
+
+/* Trace dump: send a bunch of binary data in both transmit modes. */
+static void BenchDump(File_t *par) {
+  uint32_t frames;
+
+  for (int i = 0; i < CHUNK; i++)
+    Chunk[i] = i;
+
+  frames = ReadFrameCounter();
+  for (int i = 0; i < NBYTES / CHUNK; i++)
+    FileWrite(par, Chunk, CHUNK);
+  frames = ReadFrameCounter() - frames;
+  Report("Interrupt", NBYTES, frames);
+
+  frames = ReadFrameCounter();
+  for (int i = 0; i < NBYTES / CHUNK; i++)
+    ParallelWriteBulk(Chunk, CHUNK);
+  frames = ReadFrameCounter() - frames;
+  Report("Bulk", NBYTES, frames);
+}
+
+/* Program upload: receive a file prefixed with its size. */
+static void Upload(File_t *par) {
+  uint32_t size, left, sum = 0;
+  uint32_t frames;
+
+  printf("[Upload] Waiting for data...\n");
+
+  FileRead(par, &size, sizeof(size));
+
+  frames = ReadFrameCounter();
+  for (left = size; left > 0;) {
+    size_t n = min(left, (uint32_t)CHUNK);
+    FileRead(par, Chunk, n);
+    for (size_t i = 0; i < n; i++)
+      sum += Chunk[i];
+    left -= n;
+  }
+  frames = ReadFrameCounter() - frames;
+
+  Report("Upload", size, frames);
+  printf("[Upload] checksum %08x\n", (unsigned)sum);
+}
+
+static void vMainTask(__unused void *data) {
+  File_t *par = ParallelOpen();
+
+  /* Kernel console must not poke parallel port behind driver's back. */
+  KernCons = par;
+
+  BenchDump(par);
+  Upload(par);
+
+  printf("[Parallel] Finished!\n");
+
+  for (;;)
+    continue;
+}
+
+static void SystemClockTickHandler(__unused void *data) {
+  /* Increment the system timer value and possibly preempt. */
+  uint32_t ulSavedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+  xNeedRescheduleTask = xTaskIncrementTick();
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(ulSavedInterruptMask);
+}
+
+INTSERVER_DEFINE(SystemClockTick, 10, SystemClockTickHandler, NULL);
+
+static xTaskHandle handle;
+
+int main(void) {
+  portNOP(); /* Breakpoint for simulator. */
+
+  AddIntServer(VertBlankChain, SystemClockTick);
+
+  xTaskCreate(vMainTask, "main", configMINIMAL_STACK_SIZE, NULL,
+              mainMAIN_TASK_PRIORITY, &handle);
+
+  vTaskStartScheduler();
+
+  return 0;
+}
+
+void vApplicationIdleHook(void) {
+  custom.color[0] = 0x00f;
+}
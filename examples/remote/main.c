@@ -0,0 +1,198 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+#include <FreeRTOS/queue.h>
+
+#include <cia.h>
+#include <custom.h>
+#include <floppy.h>
+#include <interrupt.h>
+#include <remote.h>
+#include <serlink.h>
+#include <stdio.h>
+
+#define mainBENCHMARK_TASK_PRIORITY 1
+#define mainFLOPPY_TASK_PRIORITY 3
+#define mainLINK_TASK_PRIORITY 3
+
+#define BAUD 115200
+#define NTRACKS 20
+#define NBYTES (NTRACKS * SECTOR_COUNT * SECTOR_SIZE)
+#define CHUNK SECTOR_SIZE
+
+static uint32_t Checksum(const uint32_t *data, size_t nbyte) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < nbyte / sizeof(uint32_t); i++)
+    sum += data[i];
+  return sum;
+}
+
+static void Report(const char *what, uint32_t frames, uint32_t sum) {
+  /* PAL frame counter advances 50 times per second. */
+  printf("[%s] %d bytes in %d frames, %d bytes/s, checksum %08x\n", what,
+         NBYTES, (int)frames, (int)(frames ? NBYTES * 50 / frames : 0),
+         (unsigned)sum);
+}
+
+/* Read first tracks of the disk image served by the host, in sector sized
+ * chunks, the way a file system client would do. */
+static void BenchRemote(void) {
+  static uint32_t buf[CHUNK / sizeof(uint32_t)];
+  SerLinkStats_t stats;
+  uint32_t sum = 0;
+  File_t *f;
+
+  RemoteInit(BAUD, mainLINK_TASK_PRIORITY);
+
+  if (!(f = RemoteOpen("remote.adf"))) {
+    printf("[Remote] Cannot open disk image!\n");
+    RemoteKill();
+    return;
+  }
+
+  uint32_t frames = ReadFrameCounter();
+  for (int i = 0; i < NBYTES / CHUNK; i++) {
+    if (FileRead(f, buf, CHUNK) != CHUNK)
+      break;
+    sum += Checksum(buf, CHUNK);
+  }
+  frames = ReadFrameCounter() - frames;
+
+  FileClose(f);
+  SerLinkGetStats(&stats);
+  RemoteKill();
+
+  Report("Remote", frames, sum);
+  printf("[Remote] frames sent %d (resent %d), received %d bytes, "
+         "bad crc %d\n",
+         (int)stats.sent, (int)stats.resent, (int)stats.received,
+         (int)stats.badcrc);
+}
+
+/* Read the same data in track sized chunks with two asynchronous requests,
+ * so one chunk is checksummed while the other one is being received. */
+static void BenchRemoteAsync(void) {
+  static uint32_t buf[2][SECTOR_COUNT * SECTOR_SIZE / sizeof(uint32_t)];
+  QueueHandle_t replyQ = xQueueCreate(2, sizeof(FileReq_t *));
+  FileReq_t req[2];
+  uint32_t sum = 0;
+  File_t *f;
+
+  RemoteInit(BAUD, mainLINK_TASK_PRIORITY);
+
+  if (!(f = RemoteOpen("remote.adf"))) {
+    printf("[Remote] Cannot open disk image!\n");
+    RemoteKill();
+    vQueueDelete(replyQ);
+    return;
+  }
+
+  for (short i = 0; i < 2; i++) {
+    req[i].buf = buf[i];
+    req[i].nbyte = sizeof(buf[i]);
+    req[i].replyQueue = replyQ;
+  }
+
+  /* Only one request per file may be in progress, so the next one is sent
+   * as soon as the previous one is done. */
+  uint32_t frames = ReadFrameCounter();
+  (void)FileReadAsync(f, &req[0]);
+  for (short track = 0; track < NTRACKS; track++) {
+    FileReq_t *done = FileWaitAsync(replyQ);
+    if (done->result != (long)sizeof(buf[0]))
+      break;
+    if (track + 1 < NTRACKS)
+      (void)FileReadAsync(f, &req[(track + 1) & 1]);
+    sum += Checksum(done->buf, done->result);
+  }
+  frames = ReadFrameCounter() - frames;
+
+  FileClose(f);
+  RemoteKill();
+  vQueueDelete(replyQ);
+
+  Report("Remote async", frames, sum);
+}
+
+/* Read the same tracks from the disk with double buffering. */
+static void BenchFloppy(void) {
+  static uint32_t buf[SECTOR_COUNT * SECTOR_SIZE / sizeof(uint32_t)];
+  QueueHandle_t replyQ = xQueueCreate(2, sizeof(FloppyIO_t *));
+  FloppyIO_t io[2];
+  uint32_t sum = 0;
+
+  FloppyInit(mainFLOPPY_TASK_PRIORITY);
+
+  for (short i = 0; i < 2; i++) {
+    io[i].cmd = CMD_READ;
+    io[i].unit = 0;
+    io[i].buffer = AllocTrack();
+    io[i].replyQueue = replyQ;
+  }
+
+  uint32_t frames = ReadFrameCounter();
+  for (short track = 0; track < NTRACKS + 1; track++) {
+    if (track < NTRACKS) {
+      io[track & 1].track = track;
+      FloppySendIO(&io[track & 1]);
+    }
+    if (track > 0) {
+      DiskSector_t *sectors[SECTOR_COUNT_MAX];
+      FloppyIO_t *done;
+      (void)xQueueReceive(replyQ, &done, portMAX_DELAY);
+      uint32_t found =
+        DecodeTrack(done->buffer, done->geometry, done->track, sectors);
+      /* Disk image on the host side is DD. */
+      for (int j = 0; j < SECTOR_COUNT; j++)
+        if (found & BIT(j))
+          DecodeSector(sectors[j], buf + j * SECTOR_SIZE / sizeof(uint32_t));
+      sum += Checksum(buf, sizeof(buf));
+    }
+  }
+  frames = ReadFrameCounter() - frames;
+
+  FloppyKill();
+  for (short i = 0; i < 2; i++)
+    vPortFree(io[i].buffer);
+  vQueueDelete(replyQ);
+
+  Report("Floppy", frames, sum);
+}
+
+static void vBenchmarkTask(__unused void *data) {
+  BenchRemote();
+  BenchRemoteAsync();
+  BenchFloppy();
+
+  printf("[Benchmark] Finished!\n");
+
+  for (;;)
+    continue;
+}
+
+static void SystemClockTickHandler(__unused void *data) {
+  /* Increment the system timer value and possibly preempt. */
+  uint32_t ulSavedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+  xNeedRescheduleTask = xTaskIncrementTick();
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(ulSavedInterruptMask);
+}
+
+INTSERVER_DEFINE(SystemClockTick, 10, SystemClockTickHandler, NULL);
+
+static xTaskHandle handle;
+
+int main(void) {
+  portNOP(); /* Breakpoint for simulator. */
+
+  AddIntServer(VertBlankChain, SystemClockTick);
+
+  xTaskCreate(vBenchmarkTask, "bench", configMINIMAL_STACK_SIZE, NULL,
+              mainBENCHMARK_TASK_PRIORITY, &handle);
+
+  vTaskStartScheduler();
+
+  return 0;
+}
+
+void vApplicationIdleHook(void) {
+  custom.color[0] = 0x00f;
+}
@@ -117,6 +117,28 @@ static inline void BitmapCopy(bltcopy_t *bc) {
     BltCopy(bc, bc->dst.bm->planes[i], bc->src.bm->planes[i], bc->src.bm->mask);
 }
 
+/* Blitter assisted memory copy & clear. Both routines fall back to CPU when
+ * the buffer is smaller than `BltMemThreshold`, is not word aligned or does
+ * not reside in chip memory. Buffers passed to BltMemCopy must not overlap.
+ * Blitter DMA must be enabled. Routines return when the operation is done. */
+void BltMemCopy(void *dst, const void *src, size_t size);
+void BltMemClear(void *dst, size_t size);
+
+/* Buffers smaller than that (in bytes) are processed by the CPU. */
+extern size_t BltMemThreshold;
+
+/* Copy (or clear if `src` is NULL) of a memory buffer. */
+typedef struct BltMemJob {
+  void *dst;
+  const void *src;
+  size_t size;
+} BltMemJob_t;
+
+/* Hybrid mode: the CPU does its job, preferably on buffers in fast memory so
+ * it doesn't compete for the chip bus, while the blitter does the other one.
+ * The blitter job is subject to the same rules as in BltMemCopy. */
+void BltMemHybrid(const BltMemJob_t *blt, const BltMemJob_t *cpu);
+
 /* Line drawing modes. */
 typedef enum __packed {
   LINE_OR = 0,
@@ -45,6 +45,14 @@ void WaitTimerGeneric(CIATimer_t *timer, uint16_t ticks, bool spin);
  * Use TIMER_MS/TIMER_US to convert time unit to timer ticks. */
 #define WaitTimerSleep(TIMER, TICKS) WaitTimerGeneric(TIMER, TICKS, false)
 
+/* Start the timer in continuous mode to measure elapsed time. The counter
+ * wraps around after 65536 ticks, so intervals up to ~92.38ms can be measured.
+ * Each E_CLOCK tick corresponds to 10 cycles of 68000 CPU. */
+void StartTimer(CIATimer_t *timer);
+
+/* Returns number of ticks that elapsed since the timer was started. */
+uint16_t ReadTimer(CIATimer_t *timer);
+
 /* 24-bit frame counter offered by CIA A */
 uint32_t ReadFrameCounter(void);
 void SetFrameCounter(uint32_t frame);
@@ -53,6 +61,9 @@ void SetFrameCounter(uint32_t frame);
 void LineCounterInit(void);
 void LineCounterKill(void);
 void LineCounterWait(uint32_t lines);
+/* Lines counted since LineCounterInit, regardless of the counter wrapping
+ * around. Each line takes 64us. Can be called from interrupt handlers. */
+uint32_t LineCounterRead(void);
 
 /* You MUST use following procedures to access CIA Interrupt Control Register!
  * On read ICR provides pending interrupts bitmask clearing them as well.
@@ -271,9 +271,13 @@ struct Custom {
 #define DSK_SYNC 0x4489
 
 /* defines for serdat register */
+#define SERDATF_OVRUN BIT(15)
 #define SERDATF_RBF BIT(14)
 #define SERDATF_TBE BIT(13)
 #define SERDATF_TSRE BIT(12)
+#define SERDATF_RXD BIT(11)
+#define SERDATF_STP9 BIT(9) /* stop bit for 9-bit data */
+#define SERDATF_STP8 BIT(8) /* stop bit for 8-bit data */
 
 /* defines for potgo register */
 #define OUTRY BIT(15) /* Output enable for bit 14 (1=output) */
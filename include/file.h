@@ -1,6 +1,8 @@
 #ifndef _FILE_H_
 #define _FILE_H_
 
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/queue.h>
 #include <cdefs.h>
 #include <stddef.h>
 
@@ -9,23 +11,53 @@
 #define SEEK_END 2
 
 typedef struct File File_t;
+typedef struct FileReq FileReq_t;
+
+/* Describes one buffer of scatter-gather I/O. */
+typedef struct IoVec {
+  void *base;
+  size_t len;
+} IoVec_t;
 
 typedef long (*FileRead_t)(File_t *f, void *buf, size_t nbyte);
 typedef long (*FileWrite_t)(File_t *f, const void *buf, size_t nbyte);
 typedef long (*FileSeek_t)(File_t *f, long offset, int whence);
 typedef void (*FileClose_t)(File_t *f);
+typedef long (*FileReadV_t)(File_t *f, const IoVec_t *iov, int iovcnt);
+typedef long (*FileWriteV_t)(File_t *f, const IoVec_t *iov, int iovcnt);
+typedef long (*FileMap_t)(File_t *f, const void **bufp, size_t nbyte);
+typedef void (*FileUnmap_t)(File_t *f, const void *buf, size_t nbyte);
+typedef bool (*FileReadAsync_t)(File_t *f, FileReq_t *req);
 
+/* Operations below `close` are optional. If they're not provided then
+ * FileReadV, FileWriteV and FileMap fall back to read and write,
+ * and FileReadAsync passes the request to a worker task. */
 typedef struct {
   FileRead_t read;
   FileWrite_t write;
   FileSeek_t seek;
   FileClose_t close;
+  FileReadV_t readv;
+  FileWriteV_t writev;
+  FileMap_t map;
+  FileUnmap_t unmap;
+  FileReadAsync_t readasync;
 } FileOps_t;
 
+/* Write buffering modes. */
+#define FBUF_NONE 0 /* unbuffered, default */
+#define FBUF_LINE 1 /* flush buffer when newline character is written */
+#define FBUF_FULL 2 /* flush buffer only when it gets full */
+
 typedef struct File {
   FileOps_t *ops;
   short usecount;
   long offset;
+  /* optional write buffer, set up with FileSetBuf */
+  short wbufmode;
+  char *wbuf;
+  size_t wbufsize;
+  size_t wbuflen;
 } File_t;
 
 /* These behave like read/write/lseek known from UNIX */
@@ -34,6 +66,52 @@ long FileWrite(File_t *f, const void *buf, size_t nbyte);
 long FileSeek(File_t *f, long offset, int whence);
 void FileClose(File_t *f);
 
+/* Scatter-gather versions of FileRead & FileWrite. Buffers are processed in
+ * order, and transfer stops at first one that was not fully transferred.
+ * Return total number of bytes transferred. */
+long FileReadV(File_t *f, const IoVec_t *iov, int iovcnt);
+long FileWriteV(File_t *f, const IoVec_t *iov, int iovcnt);
+
+/* Like FileRead, but instead of copying data into user buffer it stores
+ * in `*bufp` a pointer to up to `nbyte` bytes of data owned by the driver.
+ * May return fewer bytes than requested (e.g. up to the end of decoded track),
+ * but the file position is advanced as with FileRead. The buffer must be
+ * returned with FileUnmap before any other operation on the file is done.
+ * Files that cannot lend their buffers read data into a temporary one. */
+long FileMap(File_t *f, const void **bufp, size_t nbyte);
+void FileUnmap(File_t *f, const void *buf, size_t nbyte);
+
+/* Asynchronous read request. The caller fills in `buf`, `nbyte` and
+ * `replyQueue`. Once the request is completed `result` is set the way
+ * FileRead would return it and request pointer is sent to `replyQueue`. */
+struct FileReq {
+  File_t *file;
+  void *buf;
+  size_t nbyte;
+  long result;
+  QueueHandle_t replyQueue;
+};
+
+/* Start the task that performs requests for files without native support
+ * for asynchronous reads. It must be called before such requests are made. */
+void FileAsyncInit(unsigned aWorkerTaskPrio);
+void FileAsyncKill(void);
+
+/* Queue read from current file position and return immediately. No other
+ * operation may be done on the file until the request is completed.
+ * Returns false if the request could not be queued. */
+bool FileReadAsync(File_t *f, FileReq_t *req);
+/* Block until a request is completed and return it. */
+FileReq_t *FileWaitAsync(QueueHandle_t replyQueue);
+
+/* Attach a write buffer of `size` bytes to the file. The buffer is owned by
+ * the caller and must outlive the file or be detached with FBUF_NONE mode.
+ * Buffered file must not be written concurrently by more than one task. */
+void FileSetBuf(File_t *f, short mode, void *buf, size_t size);
+/* Passes buffered data to the driver. FileClose calls it automatically.
+ * Returns -1 if the driver did not take all of it, the rest stays buffered. */
+long FileFlush(File_t *f);
+
 void FilePutChar(File_t *f, char c);
 void FilePrintf(File_t *f, const char *fmt, ...);
 void FileHexDump(File_t *f, void *ptr, size_t length);
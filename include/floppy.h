@@ -3,6 +3,7 @@
 
 #include <FreeRTOS/FreeRTOS.h>
 #include <FreeRTOS/queue.h>
+#include <file.h>
 #include <stdint.h>
 
 /*
@@ -12,34 +13,272 @@
  * Floppy disk rotates at 300 RPM, and transfer rate is 500Kib/s - which gives
  * exactly 12800 bytes per track. With Amiga track encoding that gives a gap of
  * 832 bytes between the end of sector #10 and beginning of sector #0.
+ *
+ * High density drive spins HD disks at 150 RPM with the same transfer rate,
+ * so twice as much data - 22 sectors - fits on a track.
  */
 
 #define SECTOR_COUNT 11
+#define SECTOR_COUNT_HD 22
+#define SECTOR_COUNT_MAX SECTOR_COUNT_HD
 #define SECTOR_SIZE 512
 #define TRACK_COUNT 160
 #define TRACK_SIZE 12800
+#define TRACK_SIZE_HD 25600
+#define TRACK_SIZE_MAX TRACK_SIZE_HD
 #define FLOPPY_SIZE (SECTOR_SIZE * SECTOR_COUNT * TRACK_COUNT)
+#define TRACK_DATA_SIZE (SECTOR_SIZE * SECTOR_COUNT)
+#define TRACK_DATA_SIZE_MAX (SECTOR_SIZE * SECTOR_COUNT_MAX)
+#define SECTOR_MASK(n) ((uint32_t)(BIT(n) - 1))
+#define ALL_SECTORS SECTOR_MASK(SECTOR_COUNT)
+
+/* Track geometry depends on the drive and the disk inserted into it. */
+typedef struct FloppyGeometry {
+  uint16_t sectors;   /* sectors per track */
+  uint16_t trackSize; /* bytes of raw track data transferred at once */
+} FloppyGeometry_t;
+
+extern const FloppyGeometry_t FloppyGeometryDD;
+extern const FloppyGeometry_t FloppyGeometryHD;
 
-typedef uint16_t DiskTrack_t[TRACK_SIZE/sizeof(uint16_t)];
+/* Large enough for a track of any geometry. */
+typedef uint16_t DiskTrack_t[TRACK_SIZE_MAX/sizeof(uint16_t)];
 typedef struct DiskSector DiskSector_t;
 
+/* Drives DF0 to DF3. */
+#define FLOPPY_UNITS 4
+
+/* Identification reported by the drive. */
+#define FLOPPY_ID_NONE 0x00000000
+#define FLOPPY_ID_DD 0xffffffff
+#define FLOPPY_ID_HD 0xaaaaaaaa /* HD drive with HD disk inserted */
+
 #define CMD_READ 1
 #define CMD_WRITE 2
 
+/* Error codes reported in FloppyIO_t. */
+#define FLOPPY_OK 0
+#define FLOPPY_ERR_WRPROT 1  /* disk is write protected */
+#define FLOPPY_ERR_CHANGED 2 /* disk changed since data was read */
+
 typedef struct FloppyIO {
   uint16_t cmd;            /* command code */
+  uint16_t unit;           /* drive number, 0 for DF0 */
   uint16_t track;          /* track number to transfer */
   DiskTrack_t *buffer;     /* chip memory buffer */
   xQueueHandle replyQueue; /* after request is handled it'll be replied here */
+  const FloppyGeometry_t *geometry; /* set by the driver, by caller to write */
+  uint32_t diskChanges; /* set by caller to write: FloppyDiskChanges value */
+  uint32_t seekTime; /* set by the driver: microseconds spent moving heads */
+  int16_t error;     /* set by the driver: FLOPPY_OK or one of FLOPPY_ERR_* */
+  uint32_t sent;     /* set by the driver: LineCounterRead at FloppySendIO */
 } FloppyIO_t;
 
+/* Every drive found gets its own task with given priority. Heads of one drive
+ * are moved while another drive transfers data. */
 void FloppyInit(unsigned aFloppyIOTaskPrio);
 void FloppyKill(void);
 
-#define AllocTrack() pvPortMallocChip(TRACK_SIZE)
+/* Returns FLOPPY_ID_NONE if there's no such drive. HD drives are identified
+ * again whenever a disk is inserted, as they report HD only for HD disks. */
+uint32_t FloppyDriveID(short unit);
+const FloppyGeometry_t *FloppyGetGeometry(short unit);
 
+#define AllocTrack() pvPortMallocChip(TRACK_SIZE_MAX)
+
+/* Each drive has its own queue, whose requests are not serviced in FIFO
+ * order. Heads sweep inwards across the disk servicing requests on the way and
+ * then jump back (C-SCAN). Request passed over by a few others is serviced
+ * first to avoid starvation. */
 void FloppySendIO(FloppyIO_t *io);
-void DecodeTrack(DiskTrack_t *track, DiskSector_t *sectors[SECTOR_COUNT]);
-void DecodeSector(DiskSector_t *sector, uint32_t *buf);
+
+/* Locate sectors of track number `num` in raw track buffer read with given
+ * geometry. Sectors with damaged headers or belonging to other tracks are
+ * skipped. Returns bitmask of sectors found (bit N stands for sector N),
+ * the others are set to NULL. */
+uint32_t DecodeTrack(DiskTrack_t *track, const FloppyGeometry_t *geometry,
+                     uint16_t num, DiskSector_t *sectors[]);
+/* Decode sector data into `buf`. Returns false if data checksum is wrong. */
+bool DecodeSector(DiskSector_t *sector, uint32_t *buf);
+/* Verify data checksum without decoding, e.g. while the blitter decodes. */
+bool VerifySector(DiskSector_t *sector);
+
+/* Read the track into `io->buffer` and decode sectors selected by `mask` into
+ * `buf` at offset N * SECTOR_SIZE for sector N. The track is read again up to
+ * FLOPPY_RETRIES times if any of them is missing or damaged. `io` must have
+ * its unit, buffer and reply queue set up. Returns mask of sectors not read,
+ * including those beyond the number of sectors of the disk. */
+#define FLOPPY_RETRIES 3
+
+uint32_t FloppyReadSectors(FloppyIO_t *io, uint16_t track, uint32_t mask,
+                           void *buf);
+
+/* Blitter decoder and encoder must be initialized before use. */
+void FloppyBltInit(void);
+void FloppyBltKill(void);
+
+/* Start decoding data of `n` sectors into `buf` (n * SECTOR_SIZE bytes) with
+ * the blitter and return immediately. Both the track and `buf` must reside in
+ * chip memory, so use DecodeSector for buffers in fast memory. The blitter
+ * runs a chain of blits started from its interrupt, so it must not be used
+ * for anything else until BltDecodeWait returns. Tasks that decode or encode
+ * at the same time are served one after another, and each one must call
+ * BltDecodeWait or BltEncodeWait for its own request. */
+void BltDecodeTrack(DiskSector_t *sectors[], short n, void *buf);
+void BltDecodeWait(void);
+
+/* Encode sectors of track number `num` from `buf` into a raw track image
+ * that can be written with CMD_WRITE. Data of sector N is taken from offset
+ * N * SECTOR_SIZE, checksums are generated. */
+void EncodeTrack(DiskTrack_t *track, const FloppyGeometry_t *geometry,
+                 uint16_t num, const void *buf);
+
+/* Same as EncodeTrack, but sector data is encoded by the blitter, while
+ * the CPU is free after the call returns. Both the track and `buf` must
+ * reside in chip memory. The track is complete when BltEncodeWait returns,
+ * and the blitter is busy until then, as with BltDecodeTrack. */
+void BltEncodeTrack(DiskTrack_t *track, const FloppyGeometry_t *geometry,
+                    uint16_t num, const void *buf);
+void BltEncodeWait(void);
+
+/* Encode data of all sectors of the disk from `buf` and write it as track
+ * number `track`. `io` must be set up as for FloppyReadSectors, and its
+ * `diskChanges` must be the FloppyDiskChanges value taken when the data was
+ * read from the disk. Data is written with write precompensation on the inner
+ * half of the disk. Returns false if the disk is write protected or was
+ * changed since then. */
+bool FloppyWriteTrack(FloppyIO_t *io, uint16_t track, const void *buf);
+
+typedef struct FloppyStats {
+  uint32_t transfers; /* tracks transferred */
+  uint32_t seeks;     /* transfers that required moving the heads */
+  uint32_t steps;     /* head steps */
+  uint32_t reversals; /* changes of stepping direction */
+  uint32_t seekTime;  /* microseconds spent stepping and settling the heads */
+  uint32_t rereads;   /* tracks read again due to damaged sectors */
+  uint32_t spinups;   /* times the motor was turned on */
+  uint32_t prefetches;     /* tracks read ahead while the drive was idle */
+  uint32_t prefetchHits;   /* requests served from tracks read ahead */
+  uint32_t prefetchWasted; /* tracks read ahead, but dropped unused */
+  uint32_t writes;         /* tracks written */
+} FloppyStats_t;
+
+void FloppyGetStats(short unit, FloppyStats_t *stats);
+
+/*
+ * Time spent by each request in consecutive phases of its service is
+ * measured with the line counter (64us per line) and collected into
+ * histograms with logarithmic buckets. Bucket 0 counts phases that took no
+ * time, bucket N > 0 those that took [2^(N-1), 2^N) lines, and the last one
+ * everything longer. Requests served from tracks read ahead skip most phases.
+ */
+typedef enum FloppyPhase {
+  FLOPPY_PHASE_QUEUE,  /* since FloppySendIO until the drive task takes it */
+  FLOPPY_PHASE_SPINUP, /* waiting for the motor to reach full speed */
+  FLOPPY_PHASE_SEEK,   /* stepping the heads and switching sides */
+  FLOPPY_PHASE_SETTLE, /* waiting for the heads to settle */
+  FLOPPY_PHASE_DMA,    /* since the transfer was started until DSKBLK */
+  FLOPPY_PHASE_WAKEUP, /* since DSKBLK until the drive task runs again */
+  FLOPPY_PHASE_TOTAL,  /* since FloppySendIO until the reply is sent */
+  FLOPPY_PHASES
+} FloppyPhase_t;
+
+#define FLOPPY_HIST_BUCKETS 16
+
+typedef struct FloppyHistogram {
+  uint32_t count[FLOPPY_HIST_BUCKETS];
+  uint32_t sum; /* lines spent in the phase by all requests */
+  uint32_t max;
+} FloppyHistogram_t;
+
+void FloppyGetHistograms(short unit, FloppyHistogram_t hist[FLOPPY_PHASES]);
+void FloppyResetHistograms(short unit);
+
+/* Print histograms of the drive, e.g. to the serial port, one line per
+ * phase: "[FloppyHist] <unit> <phase> <sum> <max> <count 0> ... <count 15>".
+ * tools/floppyhist.py turns them into a per-phase breakdown. */
+void FloppyDumpHistograms(File_t *f, short unit);
+
+/* While the motor is on and there are no requests, each drive reads up to
+ * `prefetch` tracks following the last requested one into its own buffers.
+ * The motor is turned off after twice the average time between requests,
+ * bounded by `motorMin` and `motorMax`. */
+#define FLOPPY_PREFETCH_MAX 4
+
+typedef struct FloppyPolicy {
+  short prefetch;    /* number of tracks to read ahead, 0 disables it */
+  uint16_t motorMin; /* bounds for motor-off delay in milliseconds */
+  uint16_t motorMax;
+} FloppyPolicy_t;
+
+void FloppySetPolicy(const FloppyPolicy_t *policy);
+
+/* Delays in microseconds the driver waits for: after each head step, after
+ * stepping direction was changed, for the heads to settle after stepping, and
+ * after switching sides. Settling is skipped if the heads did not move. */
+typedef struct FloppySeekProfile {
+  uint16_t step;
+  uint16_t reverse;
+  uint16_t settle;
+  uint16_t side;
+} FloppySeekProfile_t;
+
+/* Timing from drive specification, used by default. */
+extern const FloppySeekProfile_t FloppySeekStandard;
+/* Shorter step and reverse delays that most drives can handle. */
+extern const FloppySeekProfile_t FloppySeekFast;
+
+void FloppySetSeekProfile(short unit, const FloppySeekProfile_t *profile);
+
+/* Incremented each time the disk is removed from the drive. */
+uint32_t FloppyDiskChanges(short unit);
+
+/*
+ * Cache of decoded tracks of DF0 kept in fast memory with LRU replacement.
+ * It sits on top of FloppySendIO, so it must be initialized after FloppyInit.
+ * All cached tracks are dropped when the disk is changed.
+ *
+ * Writes are cached as well. Modified tracks are written back as a whole by
+ * a flusher task running with `flushPrio` priority, once no track was
+ * written for TRACKCACHE_FLUSH_DELAY milliseconds, or right away if the cache
+ * has grown beyond its size. Modified tracks of a disk that was removed before
+ * they were written back are lost.
+ */
+#define TRACKCACHE_FLUSH_DELAY 1000
+
+void TrackCacheInit(short ntracks, unsigned flushPrio);
+void TrackCacheKill(void);
+
+/* Change the number of cached tracks. Tracks in use are not dropped until
+ * they're released. */
+void TrackCacheSetSize(short ntracks);
+
+/* Return decoded contents of a track (all sectors of the disk, at most
+ * TRACK_DATA_SIZE_MAX bytes). Blocks until
+ * the track is read if it's not in the cache. The data stays intact until
+ * it is returned with TrackCacheRelease. Returns NULL if out of memory or
+ * the track could not be read. */
+const void *TrackCacheGet(short track);
+void TrackCacheRelease(const void *data);
+
+/* Replace sectors of a track selected by `mask` with data from `buf` at offset
+ * N * SECTOR_SIZE for sector N. The track is read first, unless all of its
+ * sectors are replaced. Returns false if it could not be read, or the disk
+ * was changed in the meantime. */
+bool TrackCacheWrite(short track, uint32_t mask, const void *buf);
+/* Write back all modified tracks. Returns false if any of them failed. */
+bool TrackCacheSync(void);
+
+typedef struct TrackCacheStats {
+  uint32_t hits;          /* tracks found in the cache */
+  uint32_t misses;        /* tracks read from the disk */
+  uint32_t invalidations; /* cache flushes due to disk change */
+  uint32_t writes;        /* calls to TrackCacheWrite */
+  uint32_t flushes;       /* modified tracks written back */
+  uint32_t discarded;     /* modified tracks lost due to disk change */
+  uint32_t failed;        /* modified tracks that could not be written */
+} TrackCacheStats_t;
+
+void TrackCacheGetStats(TrackCacheStats_t *stats);
 
 #endif /* !_FLOPPY_H_ */
@@ -0,0 +1,38 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <FreeRTOS/FreeRTOS.h>
+#include <file.h>
+
+/*
+ * Parallel port is connected to CIA-A port B. Writing a byte to the port
+ * makes CIA-A pulse the strobe line. The peer acknowledges each byte with
+ * a pulse on ACK line, which raises FLG interrupt of CIA-A. In the other
+ * direction the peer strobes ACK line after putting a byte onto data lines.
+ *
+ * The port is half-duplex. It's switched to output only while there is data
+ * to transmit, otherwise it listens to the peer.
+ *
+ * Kernel console uses parallel port as well, so while this driver is active
+ * KernCons should be redirected to the file returned by ParallelOpen.
+ *
+ * The other end of the port is implemented by tools/parlink.py.
+ */
+
+File_t *ParallelOpen(void);
+
+void ParallelInit(void);
+void ParallelKill(void);
+
+/* Copy the whole buffer into transmit buffer, blocking while it is full.
+ * Each byte is sent by ACK interrupt handler. */
+void ParallelWrite(const void *buf, size_t nbyte);
+/* Bulk mode: wait for transmit buffer to drain, then send data directly from
+ * the buffer, polling BUSY line instead of waiting for ACK interrupts. */
+void ParallelWriteBulk(const void *buf, size_t nbyte);
+/* Block until some data is received, then copy out up to `nbyte` bytes. */
+size_t ParallelRead(void *buf, size_t nbyte);
+/* Read `nbyte` bytes. Returns fewer if timeout (in ticks) expires. */
+size_t ParallelReadExact(void *buf, size_t nbyte, TickType_t timeout);
+
+#endif /* !_PARALLEL_H_ */
@@ -0,0 +1,39 @@
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+#include <file.h>
+
+/*
+ * Unidirectional byte stream between tasks backed by a ring buffer.
+ *
+ * Reading blocks until some data is available and returns 0 once the writer
+ * has been closed and all data has been consumed. Writing blocks until all
+ * data is put into the buffer, and stops early if the reader has been closed.
+ * The pipe is released when both of its ends are closed.
+ *
+ * At most one task may read and at most one task or interrupt handler may
+ * write at a time.
+ */
+
+/* Create a pipe that buffers up to `size` bytes. Size is rounded up to
+ * a power of two, which must not exceed 32768. */
+bool PipeOpen(size_t size, File_t **readerp, File_t **writerp);
+
+/* Reader is woken up only when at least `level` bytes are available (or the
+ * writer gets closed). Set to 1 by default. */
+void PipeSetTrigger(File_t *reader, size_t level);
+
+/* Write from interrupt handler without blocking. Returns the number of bytes
+ * that fitted into the buffer. */
+size_t PipeWriteFromISR(File_t *writer, const void *buf, size_t nbyte);
+
+/* Zero-copy write: get a contiguous span of up to `nbyte` bytes of free space
+ * inside the pipe buffer, blocking until there is some. The caller fills it in
+ * and passes it to the reader with PipeCommit. The span may be shorter than
+ * requested when it reaches the end of the buffer. Returns the span size,
+ * or -1 if the reader has been closed. */
+long PipeReserve(File_t *writer, void **bufp, size_t nbyte);
+/* Commit first `nbyte` bytes of reserved span. */
+void PipeCommit(File_t *writer, size_t nbyte);
+
+#endif /* !_PIPE_H_ */
@@ -0,0 +1,42 @@
+#ifndef _READAHEAD_H_
+#define _READAHEAD_H_
+
+#include <file.h>
+
+/*
+ * Read-ahead layer that can be stacked on top of any seekable file.
+ *
+ * Reads from the underlying file start at multiple of `align` (e.g. track
+ * size) and have at least `minwin` bytes. If the reader keeps consuming data
+ * sequentially for `trigger` reads, the window doubles on each read up to
+ * `maxwin` bytes. Optionally the next window is read in background with
+ * FileReadAsync while the current one is consumed. Any non-sequential read
+ * resets the window to `minwin` and stops prefetching.
+ */
+
+typedef struct ReadAheadParams {
+  size_t align;  /* underlying reads begin at multiple of this */
+  size_t minwin; /* read size used for random access */
+  size_t maxwin; /* read size reached during sequential access */
+  short trigger; /* sequential reads needed to start growing the window */
+  bool async;    /* prefetch next window in background */
+} ReadAheadParams_t;
+
+typedef struct ReadAheadStats {
+  uint32_t hits;       /* reads served from buffered data */
+  uint32_t misses;     /* reads that waited for the underlying file */
+  uint32_t bypassed;   /* large reads passed directly to the underlying file */
+  uint32_t prefetches; /* background reads issued ahead of the reader */
+  uint32_t wasted;     /* prefetched data dropped without being used */
+} ReadAheadStats_t;
+
+/* The underlying file is closed together with returned file. Asynchronous
+ * prefetching needs FileAsyncInit if the file doesn't implement readasync. */
+File_t *ReadAheadOpen(File_t *base, const ReadAheadParams_t *params);
+
+/* Change parameters of an open file. `maxwin` cannot exceed its initial
+ * value, since buffers are allocated when the file is opened. */
+void ReadAheadSetParams(File_t *f, const ReadAheadParams_t *params);
+void ReadAheadGetStats(File_t *f, ReadAheadStats_t *stats);
+
+#endif /* !_READAHEAD_H_ */
@@ -0,0 +1,25 @@
+#ifndef _REMOTE_H_
+#define _REMOTE_H_
+
+#include <file.h>
+
+/*
+ * Read-only files served by tools/remotefs.py over reliable serial link.
+ *
+ * Files are read in blocks of REMOTE_BLKSIZE bytes. Each open file keeps up
+ * to REMOTE_READAHEAD block requests in flight, so while the reader consumes
+ * one block the following ones are already being transferred. Replies are
+ * received by a dedicated task, which also completes asynchronous reads
+ * (see FileReadAsync) by storing data straight into the caller's buffer.
+ */
+
+#define REMOTE_BLKSIZE 1024
+#define REMOTE_READAHEAD 4
+
+void RemoteInit(unsigned baud, unsigned aLinkTaskPrio);
+void RemoteKill(void);
+
+/* Returns NULL if the host failed to open the file. */
+File_t *RemoteOpen(const char *name);
+
+#endif /* !_REMOTE_H_ */
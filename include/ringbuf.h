@@ -0,0 +1,144 @@
+#ifndef _RINGBUF_H_
+#define _RINGBUF_H_
+
+#include <cdefs.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Lock-free ring buffer with single producer and single consumer, e.g. a task
+ * and an interrupt handler. Head and tail are free running 16-bit counters
+ * modified only by producer and consumer respectively. Reads and writes of
+ * words are atomic on 68000, so no critical sections are needed.
+ * Buffer size must be a power of two not greater than 32768.
+ */
+typedef struct RingBuf {
+  volatile uint16_t head; /* producer writes at this position */
+  volatile uint16_t tail; /* consumer reads from this position */
+  uint16_t size;
+  uint8_t *data;
+} RingBuf_t;
+
+/* Make sure data is written to the buffer before counter gets updated. */
+#define RingBufBarrier() asm volatile("" ::: "memory")
+
+static inline void RingBufInit(RingBuf_t *rb, void *data, uint16_t size) {
+  rb->head = 0;
+  rb->tail = 0;
+  rb->size = size;
+  rb->data = data;
+}
+
+static inline uint16_t RingBufUsed(RingBuf_t *rb) {
+  return (uint16_t)(rb->head - rb->tail);
+}
+
+static inline uint16_t RingBufFree(RingBuf_t *rb) {
+  return rb->size - RingBufUsed(rb);
+}
+
+static inline bool RingBufEmpty(RingBuf_t *rb) {
+  return rb->head == rb->tail;
+}
+
+static inline bool RingBufFull(RingBuf_t *rb) {
+  return RingBufUsed(rb) == rb->size;
+}
+
+/* Producer: append a byte. Returns false if the buffer is full. */
+static inline bool RingBufPut(RingBuf_t *rb, uint8_t byte) {
+  uint16_t head = rb->head;
+  if ((uint16_t)(head - rb->tail) == rb->size)
+    return false;
+  rb->data[head & (rb->size - 1)] = byte;
+  RingBufBarrier();
+  rb->head = head + 1;
+  return true;
+}
+
+/* Consumer: remove a byte. Returns -1 if the buffer is empty. */
+static inline int RingBufGet(RingBuf_t *rb) {
+  uint16_t tail = rb->tail;
+  if (rb->head == tail)
+    return -1;
+  uint8_t byte = rb->data[tail & (rb->size - 1)];
+  RingBufBarrier();
+  rb->tail = tail + 1;
+  return byte;
+}
+
+/* Producer: copy as much as fits in at most two spans. Returns bytes copied. */
+static inline size_t RingBufWrite(RingBuf_t *rb, const void *buf, size_t n) {
+  uint16_t head = rb->head;
+  uint16_t space = rb->size - (uint16_t)(head - rb->tail);
+  uint16_t pos = head & (rb->size - 1);
+
+  if (n > space)
+    n = space;
+  if (n == 0)
+    return 0;
+
+  size_t first = min(n, (size_t)(rb->size - pos));
+  memcpy(rb->data + pos, buf, first);
+  if (n > first)
+    memcpy(rb->data, buf + first, n - first);
+  RingBufBarrier();
+  rb->head = head + n;
+  return n;
+}
+
+/* Consumer: copy out as much as available in at most two spans.
+ * Returns bytes copied. */
+static inline size_t RingBufRead(RingBuf_t *rb, void *buf, size_t n) {
+  uint16_t tail = rb->tail;
+  uint16_t used = (uint16_t)(rb->head - tail);
+  uint16_t pos = tail & (rb->size - 1);
+
+  if (n > used)
+    n = used;
+  if (n == 0)
+    return 0;
+
+  size_t first = min(n, (size_t)(rb->size - pos));
+  memcpy(buf, rb->data + pos, first);
+  if (n > first)
+    memcpy(buf + first, rb->data, n - first);
+  RingBufBarrier();
+  rb->tail = tail + n;
+  return n;
+}
+
+/* Producer: get contiguous free space at the head, which may be filled in
+ * place and then passed to the consumer with RingBufCommit. Returns its size,
+ * which may be less than total free space when the span wraps around. */
+static inline uint16_t RingBufReserve(RingBuf_t *rb, void **spanp) {
+  uint16_t head = rb->head;
+  uint16_t space = rb->size - (uint16_t)(head - rb->tail);
+  uint16_t pos = head & (rb->size - 1);
+
+  *spanp = rb->data + pos;
+  return min(space, (uint16_t)(rb->size - pos));
+}
+
+/* Producer: pass `n` bytes of reserved span to the consumer. */
+static inline void RingBufCommit(RingBuf_t *rb, uint16_t n) {
+  RingBufBarrier();
+  rb->head += n;
+}
+
+/* Task side of a ring buffer sleeps while COND holds, i.e. the buffer is full
+ * or empty, and interrupt handler wakes it up by notifying WAITER task and
+ * clearing WAITER. The condition is checked again after the waiter is
+ * registered so that the wake up cannot be lost. If we did not go to sleep or
+ * timed out, then drop the notification that may have been sent meanwhile,
+ * so it does not wake up the task in other place. Needs FreeRTOS/task.h. */
+#define WaitFor(WAITER, COND, TICKS)                                           \
+  {                                                                            \
+    (WAITER) = xTaskGetCurrentTaskHandle();                                    \
+    if (!(COND) || !ulTaskNotifyTake(pdTRUE, (TICKS))) {                       \
+      (WAITER) = NULL;                                                         \
+      (void)ulTaskNotifyTake(pdTRUE, 0);                                       \
+    }                                                                          \
+  }
+
+#endif /* !_RINGBUF_H_ */
@@ -1,13 +1,53 @@
 #ifndef _SERIAL_H_
 #define _SERIAL_H_
 
+#include <FreeRTOS/FreeRTOS.h>
 #include <file.h>
 
 File_t *SerialOpen(unsigned baud);
 
+/* Read modes of serial port file, see Serial* procedures below. */
+typedef enum {
+  SER_READ_SOME,  /* block until some data is available */
+  SER_READ_AVAIL, /* return what is available, do not block */
+  SER_READ_EXACT, /* read exactly N bytes, unless timeout expires */
+  SER_READ_UNTIL  /* read until delimiter, unless timeout expires */
+} SerialReadMode_t;
+
+/* Select the way FileRead works for serial port file. By default it reads
+ * until newline character with no timeout. */
+void SerialSetReadMode(SerialReadMode_t mode, char delim, TickType_t timeout);
+
 void SerialInit(unsigned baud);
 void SerialKill(void);
 void SerialPutChar(char data);
 int SerialGetChar(void);
 
+/* Copy the whole buffer into transmit buffer, blocking while it is full.
+ * Each newline character is sent as "\n\r". */
+void SerialWrite(const void *buf, size_t nbyte);
+/* Same as above, but binary data is sent without any translation. */
+void SerialWriteRaw(const void *buf, size_t nbyte);
+/* Block until some data is received, then copy out up to `nbyte` bytes. */
+size_t SerialRead(void *buf, size_t nbyte);
+/* Copy out up to `nbyte` bytes that are already in receive buffer. */
+size_t SerialReadAvail(void *buf, size_t nbyte);
+/* Read `nbyte` bytes. Returns fewer if timeout (in ticks) expires. */
+size_t SerialReadExact(void *buf, size_t nbyte, TickType_t timeout);
+/* Read until `delim` (stored in the buffer), `nbyte` bytes were read
+ * or timeout (in ticks) expires. */
+size_t SerialReadUntil(void *buf, size_t nbyte, char delim,
+                       TickType_t timeout);
+
+/* Receiver statistics. */
+typedef struct SerialStats {
+  uint32_t received;  /* bytes stored in receive buffer */
+  uint32_t dropped;   /* bytes dropped because receive buffer was full */
+  uint32_t overruns;  /* bytes lost by hardware (OVRUN bit in SERDATR) */
+  uint32_t framing;   /* bytes with stop bit cleared in SERDATR */
+  uint16_t highwater; /* maximum number of bytes held in receive buffer */
+} SerialStats_t;
+
+void SerialGetStats(SerialStats_t *stats);
+
 #endif /* !_SERIAL_H_ */
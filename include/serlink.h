@@ -0,0 +1,35 @@
+#ifndef _SERLINK_H_
+#define _SERLINK_H_
+
+#include <file.h>
+#include <stdint.h>
+
+/*
+ * Reliable byte stream on top of serial port. Data is cut into frames of up
+ * to SERLINK_MTU bytes, each protected with CRC-16 and delimited with SLIP.
+ * Up to SERLINK_WINDOW frames may await acknowledgment at once. Frames that
+ * were damaged or lost are sent again after timeout (go-back-N).
+ *
+ * The other end of the link is implemented by tools/serlink.py.
+ */
+
+#define SERLINK_MTU 240
+#define SERLINK_WINDOW 4
+
+/* Takes over serial port and starts the task that receives frames. File must
+ * be read and written by at most one task at a time. FileClose waits until
+ * the peer acknowledged all sent data. */
+File_t *SerLinkOpen(unsigned baud, unsigned aLinkTaskPrio);
+
+typedef struct SerLinkStats {
+  uint32_t sent;     /* data frames sent (including retransmissions) */
+  uint32_t resent;   /* data frames retransmitted */
+  uint32_t acked;    /* payload bytes acknowledged by the peer */
+  uint32_t received; /* payload bytes received and accepted */
+  uint32_t badcrc;   /* frames dropped due to CRC mismatch */
+  uint32_t rejected; /* data frames dropped (out of order or no space) */
+} SerLinkStats_t;
+
+void SerLinkGetStats(SerLinkStats_t *stats);
+
+#endif /* !_SERLINK_H_ */
@@ -11,6 +11,15 @@ extern File_t *KernCons; /* Kernel console file (parallel port by default) */
 typedef void (*putchar_t)(char);
 void kvprintf(putchar_t, const char *fmt, va_list ap);
 
+/* Same as kvprintf, but passes output in strings as long as possible. */
+typedef void (*putstr_t)(const char *, size_t);
+void kvprintf_bulk(putstr_t, const char *fmt, va_list ap);
+
+/* Format into memory buffer of `size` bytes (including terminating NUL).
+ * Return the length of the string that would be written without truncation. */
+int snprintf(char *buf, size_t size, const char *fmt, ...);
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list ap);
+
 #define putchar(c) FilePutChar(KernCons, (c))
 #define printf(...) FilePrintf(KernCons, __VA_ARGS__)
 
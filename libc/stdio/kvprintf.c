@@ -49,8 +49,18 @@ typedef long ssize_t;
 #define NBBY 8
 
 static const char hexdigits[16] = "0123456789abcdef";
+static const char spaces[16] = "                ";
+static const char zeroes[16] = "0000000000000000";
 
-static void kprintn(putchar_t, UINTMAX_T, int, int, int);
+/* Output is passed either in strings or one character at a time. */
+typedef struct {
+  putchar_t putc;
+  putstr_t puts;
+} output_t;
+
+static void kputs(output_t *, const char *, size_t);
+static void kpad(output_t *, const char *, int);
+static void kprintn(output_t *, UINTMAX_T, int, int, int);
 
 #define LONG 0x01
 #define ALT 0x04
@@ -59,27 +69,21 @@ static void kprintn(putchar_t, UINTMAX_T, int, int, int);
 #define SIGN 0x20
 #define ZEROPAD 0x40
 #define NEGATIVE 0x80
-#define KPRINTN(base) kprintn(put, ul, base, lflag, width)
+#define KPRINTN(base) kprintn(out, ul, base, lflag, width)
 #define RADJUSTZEROPAD()                                                       \
   {                                                                            \
-    if ((lflag & (ZEROPAD | LADJUST)) == ZEROPAD) {                            \
-      while (width-- > 0)                                                      \
-        put('0');                                                              \
-    }                                                                          \
+    if ((lflag & (ZEROPAD | LADJUST)) == ZEROPAD)                              \
+      kpad(out, zeroes, width);                                                \
   }
 #define LADJUSTPAD()                                                           \
   {                                                                            \
-    if (lflag & LADJUST) {                                                     \
-      while (width-- > 0)                                                      \
-        put(' ');                                                              \
-    }                                                                          \
+    if (lflag & LADJUST)                                                       \
+      kpad(out, spaces, width);                                                \
   }
 #define RADJUSTPAD()                                                           \
   {                                                                            \
-    if ((lflag & (ZEROPAD | LADJUST)) == 0) {                                  \
-      while (width-- > 0)                                                      \
-        put(' ');                                                              \
-    }                                                                          \
+    if ((lflag & (ZEROPAD | LADJUST)) == 0)                                    \
+      kpad(out, spaces, width);                                                \
   }
 
 #define KPRINT(base)                                                           \
@@ -88,20 +92,23 @@ static void kprintn(putchar_t, UINTMAX_T, int, int, int);
     KPRINTN(base);                                                             \
   }
 
-void kvprintf(putchar_t put, const char *fmt, va_list ap) {
-  char *p;
+static void kdoprnt(output_t *out, const char *fmt, va_list ap) {
+  const char *p;
   int ch;
   UINTMAX_T ul;
   int lflag;
   int width;
-  char *q;
+  const char *q;
+  char c;
 
   for (;;) {
-    while ((ch = *fmt++) != '%') {
-      if (ch == '\0')
-        return;
-      put(ch);
-    }
+    /* Pass a run of ordinary characters to output in one go. */
+    for (p = fmt; (ch = *fmt) != '%' && ch != '\0'; ++fmt)
+      continue;
+    kputs(out, p, fmt - p);
+    if (ch == '\0')
+      return;
+    ++fmt;
     lflag = 0;
     width = 0;
   reswitch:
@@ -154,10 +161,10 @@ void kvprintf(putchar_t put, const char *fmt, va_list ap) {
           lflag |= LONG;
         goto reswitch;
       case 'c':
-        ch = va_arg(ap, int);
+        c = va_arg(ap, int);
         --width;
         RADJUSTPAD();
-        put(ch & 0xFF);
+        kputs(out, &c, 1);
         LADJUSTPAD();
         break;
       case 's':
@@ -166,8 +173,7 @@ void kvprintf(putchar_t put, const char *fmt, va_list ap) {
           continue;
         width -= q - p;
         RADJUSTPAD();
-        while ((ch = (unsigned char)*p++))
-          put(ch);
+        kputs(out, p, q - p);
         LADJUSTPAD();
         break;
       case 'd':
@@ -193,46 +199,128 @@ void kvprintf(putchar_t put, const char *fmt, va_list ap) {
       default:
         if (ch == '\0')
           return;
-        put(ch);
+        c = ch;
+        kputs(out, &c, 1);
         break;
     }
   }
 }
 
-static void kprintn(putchar_t put, UINTMAX_T ul, int base, int lflag,
+void kvprintf(putchar_t put, const char *fmt, va_list ap) {
+  output_t out = {.putc = put};
+  kdoprnt(&out, fmt, ap);
+}
+
+void kvprintf_bulk(putstr_t put, const char *fmt, va_list ap) {
+  output_t out = {.puts = put};
+  kdoprnt(&out, fmt, ap);
+}
+
+static void kputs(output_t *out, const char *s, size_t n) {
+  if (out->puts) {
+    if (n)
+      out->puts(s, n);
+  } else {
+    while (n--)
+      out->putc(*s++);
+  }
+}
+
+static void kpad(output_t *out, const char *pad, int n) {
+  while (n > 0) {
+    int len = n < 16 ? n : 16;
+    kputs(out, pad, len);
+    n -= len;
+  }
+}
+
+/*
+ * Divide 32-bit dividend by 16-bit divisor with single divu instruction.
+ * The quotient must fit in 16 bits. Returns the remainder in upper word and
+ * the quotient in lower word of the result.
+ */
+static inline uint32_t divu(uint32_t n, uint16_t d) {
+  asm("divu.w %1,%0" : "+d"(n) : "dmi"(d));
+  return n;
+}
+
+/*
+ * Convert the number to decimal in chunks of four digits. That way each
+ * division can be done with divu.w, instead of calling __udivsi3 and
+ * __umodsi3 for every single digit. Digits are stored backwards from `p`.
+ */
+static char *kconvert10(char *p, UINTMAX_T ul) {
+  uint32_t qr;
+  uint16_t r;
+
+  while (ul >= 10000) {
+    uint32_t hi = divu(ul >> 16, 10000);
+    uint32_t lo = divu((hi & 0xffff0000) | (ul & 0xffff), 10000);
+    ul = (hi << 16) | (lo & 0xffff);
+    r = lo >> 16;
+    for (int i = 0; i < 4; i++) {
+      qr = divu(r, 10);
+      *--p = '0' + (qr >> 16);
+      r = qr;
+    }
+  }
+
+  r = ul;
+  do {
+    qr = divu(r, 10);
+    *--p = '0' + (qr >> 16);
+    r = qr;
+  } while (r);
+
+  return p;
+}
+
+/* Octal and hexadecimal digits are extracted with shifts and masks. */
+static char *kconvert(char *p, UINTMAX_T ul, int base) {
+  if (base == 10)
+    return kconvert10(p, ul);
+
+  int shift = (base == 16) ? 4 : 3;
+  int mask = base - 1;
+
+  do {
+    *--p = hexdigits[ul & mask];
+    ul >>= shift;
+  } while (ul);
+
+  return p;
+}
+
+static void kprintn(output_t *out, UINTMAX_T ul, int base, int lflag,
                     int width) {
   /* hold a INTMAX_T in base 8 */
-  char *p, buf[(sizeof(INTMAX_T) * NBBY / 3) + 1 + 2 /* ALT + SIGN */];
-  char *q;
+  char buf[(sizeof(INTMAX_T) * NBBY / 3) + 1 + 2 /* ALT + SIGN */];
+  char *end = buf + sizeof(buf);
+  char *p, *q;
 
-  p = buf;
-  do {
-    *p++ = hexdigits[ul % base];
-  } while (ul /= base);
-  q = p;
-  if (lflag & ALT && *(p - 1) != '0') {
+  /* Digits are placed at the end of buffer and prefix just before them. */
+  p = q = kconvert(end, ul, base);
+  if (lflag & ALT && *q != '0') {
     if (base == 8) {
-      *p++ = '0';
+      *--p = '0';
     } else if (base == 16) {
-      *p++ = 'x';
-      *p++ = '0';
+      *--p = 'x';
+      *--p = '0';
     }
   }
   if (lflag & NEGATIVE)
-    *p++ = '-';
+    *--p = '-';
   else if (lflag & SIGN)
-    *p++ = '+';
+    *--p = '+';
   else if (lflag & SPACE)
-    *p++ = ' ';
-  width -= p - buf;
+    *--p = ' ';
+  width -= end - p;
   if (lflag & ZEROPAD) {
-    while (p > q)
-      put(*--p);
+    kputs(out, p, q - p);
+    p = q;
   }
   RADJUSTPAD();
   RADJUSTZEROPAD();
-  do {
-    put(*--p);
-  } while (p > buf);
+  kputs(out, p, end - p);
   LADJUSTPAD();
 }
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <string.h>
+
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list ap) {
+  size_t len = 0;
+
+  /* Store as much as fits, but count everything. */
+  void PutStr(const char *s, size_t n) {
+    if (len + 1 < size) {
+      size_t room = size - 1 - len;
+      memcpy(buf + len, s, n < room ? n : room);
+    }
+    len += n;
+  }
+
+  kvprintf_bulk(PutStr, fmt, ap);
+
+  if (size > 0)
+    buf[len < size ? len : size - 1] = '\0';
+
+  return len;
+}
+
+int snprintf(char *buf, size_t size, const char *fmt, ...) {
+  va_list ap;
+  int len;
+
+  va_start(ap, fmt);
+  len = vsnprintf(buf, size, fmt, ap);
+  va_end(ap);
+
+  return len;
+}
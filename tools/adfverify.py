@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+
+import argparse
+import sys
+from struct import pack, unpack
+
+from fsutil import SECTOR, checksum, load
+
+#
+# Checks floppy disk images (e.g. dumped after being written by the floppy
+# driver) created with fsutil.py. Both double density (11 sectors per track)
+# and high density (22 sectors per track) images are recognized.
+#
+
+TRACKS = 160
+GEOMETRY = {SECTOR * 11 * TRACKS: 11, SECTOR * 22 * TRACKS: 22}
+
+
+def check_bootblock(image):
+    errors = []
+    boot = image[:2 * SECTOR]
+    if boot[:4] != b'DOS\0':
+        errors.append('bootblock: missing DOS signature')
+    stored = unpack('>I', boot[4:8])[0]
+    expected = checksum(boot[:4] + pack('>I', 0) + boot[8:])
+    if stored != expected:
+        errors.append('bootblock: checksum is %08x, expected %08x' %
+                      (stored, expected))
+    return errors
+
+
+def check_directory(path, image):
+    errors = []
+    try:
+        entries = load(path)
+    except Exception as ex:
+        return ['directory: cannot be parsed (%s)' % ex]
+
+    dir_len = unpack('>H', image[2 * SECTOR:2 * SECTOR + 2])[0]
+    first = 2 + (dir_len + SECTOR - 1) // SECTOR
+
+    # load() does not report where the files are, so read the dirents again.
+    pos = 2 * SECTOR + 2
+    used = []
+    for entry in entries:
+        reclen, _, start, size = unpack('>BBHI', image[pos:pos + 8])
+        pos += reclen
+        end = start * SECTOR + size
+        if start < first:
+            errors.append('%s: starts at sector %d inside directory' %
+                          (entry.name, start))
+        if end > len(image):
+            errors.append('%s: ends beyond the disk' % entry.name)
+        if len(entry) != size:
+            errors.append('%s: truncated' % entry.name)
+        used.append((start * SECTOR, end, entry.name))
+
+    used.sort()
+    for (_, end, name), (start, _, other) in zip(used, used[1:]):
+        if start < end:
+            errors.append('%s: overlaps with %s' % (name, other))
+
+    return errors
+
+
+def compare(image, reference, nsectors):
+    errors = []
+    if len(image) != len(reference):
+        return ['reference: size differs (%d vs %d bytes)' %
+                (len(image), len(reference))]
+    for i in range(len(image) // SECTOR):
+        a = image[i * SECTOR:(i + 1) * SECTOR]
+        b = reference[i * SECTOR:(i + 1) * SECTOR]
+        if a != b:
+            errors.append('track %d sector %d: differs from reference' %
+                          (i // nsectors, i % nsectors))
+    return errors
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description='Verify floppy disk image written by the floppy driver.')
+    parser.add_argument(
+        '-r', '--reference', metavar='REFERENCE', type=str,
+        help='Image that the verified one is expected to be identical to.')
+    parser.add_argument(
+        'image', metavar='IMAGE', type=str,
+        help='Floppy disk image file.')
+    args = parser.parse_args()
+
+    with open(args.image, 'rb') as fh:
+        image = fh.read()
+
+    nsectors = GEOMETRY.get(len(image))
+    if nsectors is None:
+        raise SystemExit('%s: %d bytes is not a floppy disk image size' %
+                         (args.image, len(image)))
+
+    errors = check_bootblock(image)
+    errors += check_directory(args.image, image)
+
+    if args.reference:
+        with open(args.reference, 'rb') as fh:
+            errors += compare(image, fh.read(), nsectors)
+
+    for error in errors:
+        print('%s: %s' % (args.image, error))
+
+    if errors:
+        sys.exit(1)
+
+    print('%s: %s image is correct' %
+          (args.image, ['DD', 'HD'][nsectors == 22]))
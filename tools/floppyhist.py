@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+
+import argparse
+import re
+import sys
+from collections import OrderedDict
+
+#
+# Turns histograms printed by FloppyDumpHistograms into a breakdown of time
+# spent by floppy requests in each phase of their service. Each input line
+# looks as follows (times are in raster lines of 64us):
+#
+#  [FloppyHist] <unit> <phase> <sum> <max> <count 0> ... <count 15>
+#
+# Bucket 0 counts phases that took no time, bucket N > 0 those that took
+# [2^(N-1), 2^N) lines.
+#
+
+LINE_US = 64
+HIST_RE = re.compile(r'\[FloppyHist\] (\d+) (\w+) (\d+) (\d+)((?: \d+)+)')
+
+
+def bucket_limit(n):
+    return 0 if n == 0 else 1 << n
+
+
+def percentile(counts, fraction):
+    total = sum(counts)
+    if total == 0:
+        return 0
+    seen = 0
+    for n, count in enumerate(counts):
+        seen += count
+        if seen >= total * fraction:
+            return bucket_limit(n)
+    return bucket_limit(len(counts) - 1)
+
+
+def ms(lines):
+    return lines * LINE_US / 1000.0
+
+
+def parse(lines):
+    units = OrderedDict()
+    for line in lines:
+        m = HIST_RE.search(line)
+        if not m:
+            continue
+        unit, phase, total, longest, counts = m.groups()
+        # Later dumps supersede the earlier ones.
+        units.setdefault(int(unit), OrderedDict())[phase] = (
+            int(total), int(longest), [int(c) for c in counts.split()])
+    return units
+
+
+def report(unit, phases, verbose):
+    requests = sum(phases['total'][2]) if 'total' in phases else 0
+    overall = phases['total'][0] if 'total' in phases else 0
+
+    print('DF%d: %d requests, %.1f ms in total' %
+          (unit, requests, ms(overall)))
+    print('  %-8s %10s %8s %8s %8s %8s %6s' %
+          ('phase', 'total ms', 'mean ms', 'p50 ms', 'p90 ms', 'max ms',
+           'share'))
+
+    for phase, (total, longest, counts) in phases.items():
+        mean = total / requests if requests else 0
+        share = 100.0 * total / overall if overall else 0
+        # Percentiles are known up to the bucket they fall into.
+        p50 = min(percentile(counts, 0.5), longest)
+        p90 = min(percentile(counts, 0.9), longest)
+        print('  %-8s %10.1f %8.2f %8.2f %8.2f %8.2f %5.1f%%' %
+              (phase, ms(total), ms(mean), ms(p50), ms(p90), ms(longest),
+               share))
+        if verbose:
+            peak = max(counts) or 1
+            for n, count in enumerate(counts):
+                if count:
+                    print('    %s %8.2f ms %6d %s' %
+                          ('<' if n else '=', ms(bucket_limit(n)), count,
+                           '#' * (40 * count // peak)))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description='Show where floppy requests spend their time.')
+    parser.add_argument(
+        '-v', '--verbose', action='store_true',
+        help='Print histogram of each phase as well.')
+    parser.add_argument(
+        'log', metavar='LOG', type=str, nargs='?',
+        help='Console output with histogram dump (standard input if absent).')
+    args = parser.parse_args()
+
+    if args.log:
+        with open(args.log, 'r', errors='replace') as fh:
+            units = parse(fh)
+    else:
+        units = parse(sys.stdin)
+
+    if not units:
+        raise SystemExit('No floppy histograms found!')
+
+    for unit, phases in units.items():
+        report(unit, phases, args.verbose)
@@ -0,0 +1,283 @@
+/*
+ * Host test and benchmark of the MFM codec in drivers/floppy-mfm.c.
+ *
+ * Each track of given ADF images is encoded, written onto a simulated disk
+ * rotating slightly faster than nominal, and read back starting at a random
+ * rotational position, as disk DMA with word synchronization does. Decoded
+ * sectors must match the image. Images are encoded correctly, so each track
+ * must be decoded on the first read. Then the codec is timed on all tracks.
+ *
+ * The codec works on native words, so on little-endian hosts raw tracks are
+ * kept in host byte order. Their bit stream is the same as written by Amiga
+ * on big-endian hosts only.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Interface of drivers/floppy-mfm.c, which is built with kernel headers. */
+#define SECTOR_SIZE 512
+#define SECTOR_COUNT_MAX 22
+#define TRACK_COUNT 160
+#define TRACK_SIZE_MAX 25600
+#define DSK_SYNC 0x4489
+#define FLOPPY_RETRIES 3
+
+typedef struct FloppyGeometry {
+  uint16_t sectors;
+  uint16_t trackSize;
+} FloppyGeometry_t;
+
+typedef uint16_t DiskTrack_t[TRACK_SIZE_MAX / sizeof(uint16_t)];
+typedef struct DiskSector DiskSector_t;
+
+uint32_t DecodeTrack(DiskTrack_t *track, const FloppyGeometry_t *geometry,
+                     uint16_t num, DiskSector_t *sectors[]);
+bool DecodeSector(DiskSector_t *sector, uint32_t *buf);
+void EncodeTrack(DiskTrack_t *track, const FloppyGeometry_t *geometry,
+                 uint16_t num, const void *buf);
+
+static const FloppyGeometry_t GeometryDD = {11, 12800};
+static const FloppyGeometry_t GeometryHD = {22, 25600};
+
+/* Disk rotates up to that many percent faster than nominal, so the end of
+ * written track overlaps its beginning. */
+#define SPEED_DEVIATION 3
+
+typedef struct Disk {
+  const char *path;
+  const FloppyGeometry_t *geometry;
+  uint8_t *image;
+  DiskTrack_t *read; /* raw tracks as read from the disk */
+} Disk_t;
+
+static uint16_t Ring[TRACK_SIZE_MAX / sizeof(uint16_t)];
+static size_t RingSize; /* in words */
+
+static size_t Random(size_t n) {
+  return (size_t)rand() % n;
+}
+
+/* Write the track at random rotational position. */
+static void WriteRing(DiskTrack_t *raw, const FloppyGeometry_t *geometry) {
+  size_t words = geometry->trackSize / sizeof(uint16_t);
+  size_t start;
+
+  RingSize = words - Random(words * SPEED_DEVIATION / 100 + 1);
+  start = Random(RingSize);
+
+  for (size_t i = 0; i < words; i++)
+    Ring[(start + i) % RingSize] = (*raw)[i];
+}
+
+/* Start reading at random position, and begin the transfer after the first
+ * synchronization marker found. */
+static void ReadRing(DiskTrack_t *raw, const FloppyGeometry_t *geometry) {
+  size_t words = geometry->trackSize / sizeof(uint16_t);
+  size_t pos = Random(RingSize);
+
+  while (Ring[pos] != DSK_SYNC)
+    pos = (pos + 1) % RingSize;
+
+  for (size_t i = 0; i < words; i++)
+    (*raw)[i] = Ring[(pos + 1 + i) % RingSize];
+}
+
+static bool LoadDisk(Disk_t *disk, const char *path) {
+  FILE *fh = fopen(path, "rb");
+  long size;
+
+  if (!fh) {
+    perror(path);
+    return false;
+  }
+
+  fseek(fh, 0, SEEK_END);
+  size = ftell(fh);
+  fseek(fh, 0, SEEK_SET);
+
+  if (size == GeometryDD.sectors * SECTOR_SIZE * TRACK_COUNT) {
+    disk->geometry = &GeometryDD;
+  } else if (size == GeometryHD.sectors * SECTOR_SIZE * TRACK_COUNT) {
+    disk->geometry = &GeometryHD;
+  } else {
+    fprintf(stderr, "%s: %ld bytes is not a floppy disk image size\n", path,
+            size);
+    fclose(fh);
+    return false;
+  }
+
+  disk->path = path;
+  disk->image = malloc(size);
+  disk->read = malloc(sizeof(DiskTrack_t) * TRACK_COUNT);
+  if (fread(disk->image, size, 1, fh) != 1) {
+    perror(path);
+    fclose(fh);
+    return false;
+  }
+
+  fclose(fh);
+  return true;
+}
+
+static uint8_t *TrackData(Disk_t *disk, short track) {
+  return disk->image + track * disk->geometry->sectors * SECTOR_SIZE;
+}
+
+/* Read each track until all of its sectors are found, just like
+ * FloppyReadSectors does. Returns the number of damaged sectors and rereads,
+ * as a clean track must never be read again. */
+static int VerifyDisk(Disk_t *disk, int *rereads) {
+  const FloppyGeometry_t *geometry = disk->geometry;
+  uint32_t all = (1UL << geometry->sectors) - 1;
+  static DiskTrack_t raw;
+  static uint32_t buf[SECTOR_COUNT_MAX * SECTOR_SIZE / sizeof(uint32_t)];
+  int errors = 0;
+
+  for (short track = 0; track < TRACK_COUNT; track++) {
+    uint8_t *data = TrackData(disk, track);
+    uint32_t missing = all;
+
+    EncodeTrack(&raw, geometry, track, data);
+    WriteRing(&raw, geometry);
+
+    for (short retry = 0; missing && retry <= FLOPPY_RETRIES; retry++) {
+      DiskSector_t *sectors[SECTOR_COUNT_MAX];
+      uint32_t found;
+
+      if (retry > 0) {
+        printf("%s: track %d: read again, missing 0x%x\n", disk->path, track,
+               (unsigned)missing);
+        (*rereads)++;
+        errors++;
+      }
+
+      ReadRing(&disk->read[track], geometry);
+      found = DecodeTrack(&disk->read[track], geometry, track, sectors);
+
+      for (short i = 0; i < geometry->sectors; i++) {
+        uint32_t *sec = buf + i * SECTOR_SIZE / sizeof(uint32_t);
+        if (!(found & missing & (1UL << i)))
+          continue;
+        if (!DecodeSector(sectors[i], sec) ||
+            memcmp(sec, data + i * SECTOR_SIZE, SECTOR_SIZE)) {
+          printf("%s: track %d sector %d: decoded data differs\n",
+                 disk->path, track, i);
+          errors++;
+        }
+        missing &= ~(1UL << i);
+      }
+    }
+
+    for (short i = 0; i < geometry->sectors; i++) {
+      if (missing & (1UL << i)) {
+        printf("%s: track %d sector %d: not found\n", disk->path, track, i);
+        errors++;
+      }
+    }
+  }
+
+  return errors;
+}
+
+static double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void Report(const char *what, double bytes, double secs) {
+  printf("  %-24s %8.1f MB/s\n", what, bytes / secs / 1e6);
+}
+
+/* Tracks read during verification are decoded over and over again. */
+static void BenchDisk(Disk_t *disk, int repeat) {
+  const FloppyGeometry_t *geometry = disk->geometry;
+  static uint32_t buf[SECTOR_COUNT_MAX * SECTOR_SIZE / sizeof(uint32_t)];
+  static DiskTrack_t raw;
+  double bytes = (double)repeat * TRACK_COUNT * geometry->sectors * SECTOR_SIZE;
+  double locate = 0, decode = 0, encode = 0, t;
+
+  for (int n = 0; n < repeat; n++) {
+    for (short track = 0; track < TRACK_COUNT; track++) {
+      DiskSector_t *sectors[SECTOR_COUNT_MAX];
+      uint32_t found;
+
+      t = Now();
+      found = DecodeTrack(&disk->read[track], geometry, track, sectors);
+      locate += Now() - t;
+
+      t = Now();
+      for (short i = 0; i < geometry->sectors; i++)
+        if (found & (1UL << i))
+          (void)DecodeSector(sectors[i], buf + i * SECTOR_SIZE / 4);
+      decode += Now() - t;
+
+      t = Now();
+      EncodeTrack(&raw, geometry, track, TrackData(disk, track));
+      encode += Now() - t;
+    }
+  }
+
+  Report("locate sectors", bytes, locate);
+  Report("decode sectors", bytes, decode);
+  Report("locate and decode", bytes, locate + decode);
+  Report("encode track", bytes, encode);
+}
+
+static void Usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-n REPEAT] [-s SEED] IMAGE...\n", prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  unsigned seed = time(NULL);
+  int repeat = 10;
+  int failed = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+    if (opt == 'n')
+      repeat = atoi(optarg);
+    else if (opt == 's')
+      seed = strtoul(optarg, NULL, 0);
+    else
+      Usage(argv[0]);
+  }
+
+  if (optind == argc || repeat <= 0)
+    Usage(argv[0]);
+
+  printf("Random seed: %u\n", seed);
+  srand(seed);
+
+  for (int i = optind; i < argc; i++) {
+    Disk_t disk;
+    int errors, rereads = 0;
+
+    if (!LoadDisk(&disk, argv[i])) {
+      failed++;
+      continue;
+    }
+
+    errors = VerifyDisk(&disk, &rereads);
+    printf("%s: %s, %d tracks, %d rereads, %d errors\n", disk.path,
+           disk.geometry == &GeometryHD ? "HD" : "DD", TRACK_COUNT, rereads,
+           errors);
+
+    if (errors)
+      failed++;
+    else
+      BenchDisk(&disk, repeat);
+
+    free(disk.image);
+    free(disk.read);
+  }
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
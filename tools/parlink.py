@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+
+import argparse
+import select
+import socket
+import sys
+import time
+
+#
+# Host side of parallel port (see include/parallel.h).
+#
+# dump   : store everything the Amiga sends and report throughput,
+#          e.g. kernel console output mixed with trace dumps
+# upload : send a file prefixed with its size as big endian long word,
+#          then keep printing what the Amiga sends
+#
+# Connect to FS-UAE parallel port instead of socat started by 'launch' script.
+#
+
+
+def connect(port):
+    # The simulator will only open the server after some time has passed.
+    while True:
+        try:
+            return socket.create_connection(('127.0.0.1', port))
+        except ConnectionRefusedError:
+            time.sleep(0.01)
+
+
+def report(what, nbytes, elapsed):
+    rate = nbytes / elapsed if elapsed > 0 else 0
+    print('%s: %d bytes in %.2fs (%.0f B/s)' % (what, nbytes, elapsed, rate),
+          file=sys.stderr)
+
+
+def dump(sock, output, idle):
+    total, first, last = 0, None, None
+    while first is None or time.monotonic() - last < idle:
+        ready, _, _ = select.select([sock], [], [], 0.05)
+        if not ready:
+            continue
+        data = sock.recv(65536)
+        if not data:
+            break
+        last = time.monotonic()
+        if first is None:
+            first = last
+        total += len(data)
+        output.write(data)
+        output.flush()
+    if first is not None:
+        report('dump', total, last - first)
+
+
+def upload(sock, data):
+    start = time.monotonic()
+    sock.sendall(len(data).to_bytes(4, 'big') + data)
+    report('upload', len(data), time.monotonic() - start)
+    print('upload: checksum %08x' % (sum(data) & 0xFFFFFFFF), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description='Exchange data with Amiga over parallel port.')
+    parser.add_argument('-p', '--port', type=int, default=8001,
+                        help='TCP port of FS-UAE parallel port.')
+    parser.add_argument('-i', '--idle', type=float, default=2.0,
+                        help='Stop dumping after that many idle seconds.')
+    parser.add_argument('-o', '--output', metavar='FILE', type=str,
+                        help='Store received data in a file.')
+    parser.add_argument('mode', choices=['dump', 'upload'],
+                        help='Receive data or upload a file.')
+    parser.add_argument('file', metavar='FILE', type=str, nargs='?',
+                        help='File to upload (for upload mode).')
+    args = parser.parse_args()
+
+    if args.mode == 'upload' and not args.file:
+        raise SystemExit('%s: file to upload not provided!' % args.mode)
+
+    sock = connect(args.port)
+    output = open(args.output, 'wb') if args.output else sys.stdout.buffer
+
+    try:
+        if args.mode == 'upload':
+            with open(args.file, 'rb') as f:
+                upload(sock, f.read())
+        dump(sock, output, args.idle)
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+
+import argparse
+import os
+import os.path
+import socket
+import sys
+import time
+from struct import Struct
+
+from serlink import Link
+
+#
+# Serves read-only files from a host directory to drivers/remote-file.c.
+#
+# Request:
+#  [BYTE] #cmd    : 'O' (open), 'R' (read) or 'C' (close)
+#  [BYTE] #tag    : copied into the reply
+#  [WORD] #handle : file handle (READ & CLOSE)
+#  [LONG] #offset : file offset (READ)
+#  [WORD] #length : number of bytes to read (READ) or name length (OPEN)
+#  ...    name of the file (OPEN)
+#
+# Reply (sent in the same order as requests were received):
+#  [BYTE] #cmd    : copied from the request
+#  [BYTE] #tag    : copied from the request
+#  [WORD] #length : number of data bytes that follow the reply
+#  [LONG] #value  : handle (OPEN), bytes read (READ), or -1 on error
+#  ...    file size (OPEN) or file contents (READ)
+#
+
+REQUEST = Struct('>BBHIH')
+REPLY = Struct('>BBHi')
+
+OPEN = ord('O')
+READ = ord('R')
+CLOSE = ord('C')
+
+
+class RemoteFS():
+    def __init__(self, link, root):
+        self.link = link
+        self.root = os.path.realpath(root)
+        self.files = {}
+        self.handle = 0
+        self.sent = 0
+
+    def reply(self, cmd, tag, value, data=b''):
+        self.link.write(REPLY.pack(cmd, tag, len(data), value) + data)
+        self.sent += len(data)
+
+    def open(self, tag, name):
+        path = os.path.realpath(os.path.join(self.root, name))
+        try:
+            if not path.startswith(self.root + os.sep):
+                raise OSError('outside of served directory')
+            f = open(path, 'rb')
+        except OSError as ex:
+            print('open %r: %s' % (name, ex), file=sys.stderr)
+            return self.reply(OPEN, tag, -1)
+        size = os.fstat(f.fileno()).st_size
+        self.handle = (self.handle + 1) & 0xFFFF
+        self.files[self.handle] = f
+        print('open %r (%d bytes) as %d' % (name, size, self.handle),
+              file=sys.stderr)
+        self.reply(OPEN, tag, self.handle, size.to_bytes(4, 'big'))
+
+    def read(self, tag, handle, offset, length):
+        f = self.files.get(handle)
+        if f is None:
+            return self.reply(READ, tag, -1)
+        f.seek(offset)
+        data = f.read(length)
+        self.reply(READ, tag, len(data), data)
+
+    def close(self, tag, handle):
+        f = self.files.pop(handle, None)
+        if f is not None:
+            f.close()
+        print('close %d (%d bytes sent so far)' % (handle, self.sent),
+              file=sys.stderr)
+        self.reply(CLOSE, tag, 0 if f else -1)
+
+    def serve(self):
+        buf = bytearray()
+        while True:
+            self.link.poll(0.05)
+            buf += self.link.read()
+            while len(buf) >= REQUEST.size:
+                cmd, tag, handle, offset, length = REQUEST.unpack_from(buf)
+                size = REQUEST.size + (length if cmd == OPEN else 0)
+                if len(buf) < size:
+                    break
+                name = bytes(buf[REQUEST.size:size]).decode(errors='replace')
+                del buf[:size]
+                if cmd == OPEN:
+                    self.open(tag, name)
+                elif cmd == READ:
+                    self.read(tag, handle, offset, length)
+                elif cmd == CLOSE:
+                    self.close(tag, handle)
+                else:
+                    print('unknown request %r' % cmd, file=sys.stderr)
+
+
+def connect(port):
+    # The simulator will only open the server after some time has passed.
+    while True:
+        try:
+            return socket.create_connection(('127.0.0.1', port))
+        except ConnectionRefusedError:
+            time.sleep(0.01)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description='Serve files to Amiga over reliable serial link.')
+    parser.add_argument('-p', '--port', type=int, default=8000,
+                        help='TCP port of FS-UAE serial port.')
+    parser.add_argument('-t', '--timeout', type=float, default=0.5,
+                        help='Retransmission timeout in seconds.')
+    parser.add_argument('directory', metavar='DIR', type=str,
+                        help='Directory with files to serve.')
+    args = parser.parse_args()
+
+    if not os.path.isdir(args.directory):
+        raise SystemExit('%s: directory does not exist!' % args.directory)
+
+    fs = RemoteFS(Link(connect(args.port), args.timeout), args.directory)
+
+    try:
+        fs.serve()
+    except (KeyboardInterrupt, EOFError) as ex:
+        print(ex, file=sys.stderr)
@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+
+import argparse
+import select
+import socket
+import sys
+import time
+
+#
+# Host side of reliable serial link (see include/serlink.h).
+#
+# Frame layout (before SLIP encoding):
+#  [BYTE] #type : 'D' for data frame, 'A' for acknowledgment
+#  [BYTE] #seq  : sequence number of data frame, or the sequence number of
+#                 data frame the receiver expects next (cumulative ack)
+#  ...    payload (data frames only, up to MTU bytes)
+#  [WORD] #crc  : CRC-16/CCITT of all preceding bytes (big endian)
+#
+# Connect to FS-UAE serial port instead of socat started by 'launch' script.
+#
+
+MTU = 240
+WINDOW = 4
+
+DATA = ord('D')
+ACK = ord('A')
+
+END = 0xC0
+ESC = 0xDB
+ESC_END = 0xDC
+ESC_ESC = 0xDD
+
+
+def crc16_table():
+    table = []
+    for i in range(256):
+        crc = i << 8
+        for _ in range(8):
+            crc = (crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1
+        table.append(crc & 0xFFFF)
+    return table
+
+
+CRC_TABLE = crc16_table()
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc = ((crc << 8) & 0xFFFF) ^ CRC_TABLE[(crc >> 8) ^ byte]
+    return crc
+
+
+def slip_encode(frame):
+    frame = frame.replace(bytes([ESC]), bytes([ESC, ESC_ESC]))
+    frame = frame.replace(bytes([END]), bytes([ESC, ESC_END]))
+    return bytes([END]) + frame + bytes([END])
+
+
+def slip_decode(data):
+    frame = bytearray()
+    escape = False
+    for c in data:
+        if c == ESC:
+            escape = True
+            continue
+        if escape:
+            c = {ESC_END: END, ESC_ESC: ESC}.get(c, c)
+            escape = False
+        frame.append(c)
+    return bytes(frame)
+
+
+class Link():
+    def __init__(self, sock, timeout):
+        self.sock = sock
+        self.timeout = timeout
+        self.rxbuf = bytearray()
+        # sender state
+        self.base = 0
+        self.next = 0
+        self.window = {}
+        self.timer = time.monotonic()
+        # receiver state
+        self.expect = 0
+        self.received = bytearray()
+        # statistics
+        self.resent = 0
+        self.badcrc = 0
+        self.rejected = 0
+
+    def send_frame(self, kind, seq, payload=b''):
+        frame = bytes([kind, seq]) + payload
+        frame += crc16(frame).to_bytes(2, 'big')
+        self.sock.sendall(slip_encode(frame))
+
+    def recv_frame(self, frame):
+        if len(frame) < 4 or crc16(frame) != 0:
+            self.badcrc += 1
+            return
+        kind, seq, payload = frame[0], frame[1], frame[2:-2]
+        if kind == ACK:
+            count = (seq - self.base) & 255
+            if 0 < count <= ((self.next - self.base) & 255):
+                for _ in range(count):
+                    del self.window[self.base]
+                    self.base = (self.base + 1) & 255
+                self.timer = time.monotonic()
+        elif kind == DATA:
+            if seq == self.expect:
+                self.received += payload
+                self.expect = (self.expect + 1) & 255
+            else:
+                self.rejected += 1
+            self.send_frame(ACK, self.expect)
+
+    def poll(self, timeout):
+        ready, _, _ = select.select([self.sock], [], [], timeout)
+        if ready:
+            data = self.sock.recv(4096)
+            if not data:
+                raise EOFError('connection closed by emulator')
+            self.rxbuf += data
+            while END in self.rxbuf:
+                i = self.rxbuf.index(END)
+                frame = slip_decode(self.rxbuf[:i])
+                del self.rxbuf[:i + 1]
+                if frame:
+                    self.recv_frame(frame)
+        # Go-back-N: send again all unacknowledged frames.
+        now = time.monotonic()
+        if self.window and now - self.timer >= self.timeout:
+            seq = self.base
+            while seq != self.next:
+                self.send_frame(DATA, seq, self.window[seq])
+                self.resent += 1
+                seq = (seq + 1) & 255
+            self.timer = now
+        return bool(ready)
+
+    def write(self, data):
+        for i in range(0, len(data), MTU):
+            while len(self.window) >= WINDOW:
+                self.poll(self.timeout)
+            if not self.window:
+                self.timer = time.monotonic()
+            self.window[self.next] = data[i:i + MTU]
+            self.send_frame(DATA, self.next, self.window[self.next])
+            self.next = (self.next + 1) & 255
+
+    def flush(self):
+        while self.window:
+            self.poll(self.timeout)
+
+    def read(self):
+        data = bytes(self.received)
+        self.received.clear()
+        return data
+
+
+def report(what, nbytes, elapsed, baud):
+    rate = nbytes / elapsed if elapsed > 0 else 0
+    msg = '%s: %d bytes in %.2fs (%.0f B/s' % (what, nbytes, elapsed, rate)
+    if baud:
+        msg += ', %.1f%% of %d baud' % (rate * 1000 / baud, baud)
+    print(msg + ')', file=sys.stderr)
+
+
+def receive(link, output, idle, baud):
+    total, first, last = 0, None, None
+    while first is None or time.monotonic() - last < idle:
+        link.poll(0.05)
+        data = link.read()
+        if data:
+            last = time.monotonic()
+            if first is None:
+                first = last
+            total += len(data)
+            output.write(data)
+            output.flush()
+    report('goodput', total, last - first, baud)
+
+
+def send(link, data, baud):
+    start = time.monotonic()
+    link.write(data)
+    link.flush()
+    report('goodput', len(data), time.monotonic() - start, baud)
+
+
+def raw(sock, output, idle, baud):
+    total, first, last = 0, None, None
+    while first is None or time.monotonic() - last < idle:
+        ready, _, _ = select.select([sock], [], [], 0.05)
+        if ready:
+            data = sock.recv(4096)
+            if not data:
+                break
+            last = time.monotonic()
+            if first is None:
+                first = last
+            total += len(data)
+            output.write(data)
+            output.flush()
+    report('raw', total, last - first, baud)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description='Exchange data with Amiga over reliable serial link.')
+    parser.add_argument('-p', '--port', type=int, default=8000,
+                        help='TCP port of FS-UAE serial port.')
+    parser.add_argument('-b', '--baud', type=int, default=0,
+                        help='Baud rate used by Amiga to report efficiency.')
+    parser.add_argument('-t', '--timeout', type=float, default=0.5,
+                        help='Retransmission timeout in seconds.')
+    parser.add_argument('-i', '--idle', type=float, default=2.0,
+                        help='Stop receiving after that many idle seconds.')
+    parser.add_argument('-o', '--output', metavar='FILE', type=str,
+                        help='Store received data in a file.')
+    parser.add_argument('mode', choices=['recv', 'send', 'raw'],
+                        help='Receive or send framed data, or receive '
+                        'raw bytes to measure baseline throughput.')
+    parser.add_argument('file', metavar='FILE', type=str, nargs='?',
+                        help='File to send (for send mode).')
+    args = parser.parse_args()
+
+    if args.mode == 'send' and not args.file:
+        raise SystemExit('%s: file to send not provided!' % args.mode)
+
+    sock = socket.create_connection(('127.0.0.1', args.port))
+    output = open(args.output, 'wb') if args.output else sys.stdout.buffer
+    link = Link(sock, args.timeout)
+
+    try:
+        if args.mode == 'recv':
+            receive(link, output, args.idle, args.baud)
+        elif args.mode == 'send':
+            with open(args.file, 'rb') as f:
+                send(link, f.read(), args.baud)
+        else:
+            raw(sock, output, args.idle, args.baud)
+    except (KeyboardInterrupt, EOFError) as ex:
+        print(ex, file=sys.stderr)
+
+    print('resent: %d, bad crc: %d, rejected: %d' %
+          (link.resent, link.badcrc, link.rejected), file=sys.stderr)